@@ -17,6 +17,7 @@
 /***********************************************************************/
 
 #include "zuLib.hpp"
+#include <cstdio>
 
 void test_time()
 {
@@ -82,6 +83,533 @@ void test_file()
 	}
 }
 
+void test_mapped_file()
+{
+	Println("\nTesting memory mapped text file\n");
+	zz::TextFile tf("../../LICENSE", std::ios::in, 1);
+	Println("Mapped: " << tf.is_mapped());
+	zz::Timer t;
+	Println(tf.count_lines());
+	Println("Time elapsed: " << t.get_elapsed_time_ms() << "ms");
+
+	String line;
+	int ret = tf.goto_line(3);
+	Println("jumped to line: " << ret);
+	for (int limit = 10; limit > 0 && tf.next_line(line) >= 0; limit--)
+	{
+		Println(line);
+	}
+}
+
+void test_line_index()
+{
+	Println("\nTesting line index\n");
+	zz::TextFile tf("../../src/zuLib.cpp");
+	if (!tf.load_index())
+	{
+		Println("Build index, lines: " << tf.build_index(64));
+	}
+	Println("Indexed: " << tf.is_indexed());
+
+	String line;
+	zz::Timer t;
+	int ret = tf.goto_line(700);
+	Println("jumped to line: " << ret << " in " << t.get_elapsed_time_us() << "us");
+	tf.next_line(line);
+	Println(line);
+}
+
+void test_line_ref()
+{
+	Println("\nTesting zero-copy line view\n");
+	zz::TextFile tf("../../LICENSE");
+	zz::LineRef line;
+	while (tf.next_line(line) > 0)
+	{
+		Println(line.lineNo << " @" << line.offset << " [" << line.size << "]: " << line.str());
+	}
+}
+
+void test_line_batch()
+{
+	Println("\nTesting batched line reads\n");
+	zz::TextFile tf("../../src/zuLib.cpp");
+	zz::LineBatch batch;
+	size_t n;
+	zz::Timer t;
+	while ((n = tf.next_lines(4096, batch)) > 0)
+	{
+		Println("Batch from line " << batch.first_line() << ": " << n << " lines, "
+			<< batch.arena().size() << " bytes, last: " << batch.line(n - 1));
+	}
+	Println("Time elapsed: " << t.get_elapsed_time_ms() << "ms");
+}
+
+void test_prefetch()
+{
+	Println("\nTesting read-ahead\n");
+	zz::TextFile tf("../../src/zuLib.cpp");
+	Println("Read-ahead: " << tf.prefetch(1, 4, 64 * 1024));
+	Println("Lines: " << tf.count_lines());
+
+	zz::LineRef line;
+	size_t bytes = 0;
+	zz::Timer t;
+	while (tf.next_line(line) > 0)
+	{
+		bytes += line.size;
+	}
+	Println("Read " << bytes << " bytes in " << t.get_elapsed_time_ms() << "ms");
+}
+
+void test_compressed()
+{
+	Println("\nTesting compressed text file\n");
+#if ZULIB_OS == 1
+	zz::system("gzip -c ../../LICENSE > LICENSE.gz");
+#endif
+	zz::TextFile tf("LICENSE.gz");
+	Println("Codec: " << tf.codec() << ", supported: " << zz::Decompressor::is_supported(tf.codec()));
+	Println("Lines: " << tf.count_lines());
+
+	String line;
+	tf.goto_line(3);
+	for (int limit = 5; limit > 0 && tf.next_line(line) >= 0; limit--)
+	{
+		Println(line);
+	}
+	std::remove("LICENSE.gz");
+}
+
+void test_follow()
+{
+	Println("\nTesting follow mode, append lines to follow.txt in 10s\n");
+	{
+		std::ofstream out("follow.txt", std::ios::app);
+	}
+	zz::TextFile tf("follow.txt");
+	zz::LineRef line;
+	while (tf.follow_line(line, 10000) > 0)
+	{
+		Println(line.lineNo << ": " << line.str());
+	}
+	Println("No new line in 10s, stop following");
+}
+
+void test_delimited()
+{
+	Println("\nTesting delimited reader\n");
+	{
+		std::ofstream out("delimited.csv");
+		out << "id,name,score\n1,\"Smith, John\",3.5\n2,\"say \"\"hi\"\"\",-7\n3,\"multi\nline\", 1e3 \n";
+	}
+	zz::TextFile tf("delimited.csv");
+	zz::DelimitedReader reader(tf, ',');
+	while (reader.next_record() > 0)
+	{
+		double score;
+		Print("Line " << reader.line_number() << ":");
+		for (size_t i = 0; i < reader.size(); i++)
+		{
+			Print(" [" << reader.str(i) << "]");
+		}
+		if (reader.size() > 2 && reader.to_double(2, score))
+		{
+			Print(" score=" << score);
+		}
+		Println("");
+	}
+	std::remove("delimited.csv");
+}
+
+void test_binary_file()
+{
+	Println("\nTesting binary file\n");
+	std::vector<double> values(1000000);
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		values[i] = i * 0.5;
+	}
+
+	zz::Timer t;
+	{
+		zz::BinaryFile bf("binary_test.bin", std::ios::out);
+		bf.set_endian(zz::BinaryFile::BIG);
+		bf.write(&values.front(), values.size());
+		bf.write(static_cast<int>(values.size()));
+	}
+	Println("Write time: " << t.get_elapsed_time_ms() << "ms");
+
+	zz::BinaryFile bf("binary_test.bin");
+	bf.set_endian(zz::BinaryFile::BIG);
+	t.update();
+	std::vector<double> back(values.size());
+	size_t n = bf.read(&back.front(), back.size());
+	int count = 0;
+	bf.read(count);
+	Println("Read " << n << " values, count: " << count << ", match: " << (back == values)
+		<< ", time: " << t.get_elapsed_time_ms() << "ms");
+
+	double v = 0;
+	bf.read_at(8 * 10, &v, 1);
+	Println("Value at 10: " << v);
+
+	zz::AlignedBuffer buf;
+	n = bf.read_all<double>(buf);
+	Println("Read all: " << n << " values, last: " << buf.as<double>()[n - 1]);
+	std::remove("binary_test.bin");
+}
+
+void test_direct_io()
+{
+	Println("\nTesting direct io\n");
+	std::vector<int> values(3000001);
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		values[i] = static_cast<int>(i);
+	}
+
+	{
+		zz::BinaryFile bf("direct_test.bin", std::ios::in | std::ios::out | std::ios::trunc, 1 << 20, zz::BinaryFile::DIRECT);
+		Println("Cache mode: " << bf.cache_mode());
+		bf.write(static_cast<char>(1));
+		bf.write(&values.front(), values.size());
+	}
+
+	zz::Timer t;
+	zz::BinaryFile bf("direct_test.bin", std::ios::in, 1 << 20, zz::BinaryFile::DIRECT);
+	char head = 0;
+	bf.read(head);
+	std::vector<int> back(values.size());
+	size_t n = bf.read(&back.front(), back.size());
+	Println("Read " << n << " values, match: " << (head == 1 && back == values) << ", time: " << t.get_elapsed_time_ms() << "ms");
+
+	int v = 0;
+	bf.read_at(1 + 4 * 12345, &v, 1);
+	Println("Value at 12345: " << v);
+
+	Println("Streaming mode: " << bf.set_cache_mode(zz::BinaryFile::STREAMING));
+	bf.seek(1);
+	n = bf.read(&back.front(), back.size());
+	Println("Read " << n << " values, match: " << (back == values));
+	std::remove("direct_test.bin");
+}
+
+void test_checksum()
+{
+	Println("\nTesting checksum\n");
+	Println("CRC32C of 123456789: " << std::hex << zz::crc32c("123456789", 9) << std::dec);
+
+	{
+		zz::BinaryFile bf("checksum_test.bin", std::ios::out);
+		for (int i = 0; i < 1000000; i++)
+		{
+			bf.write(i);
+		}
+	}
+
+	zz::Timer t;
+	zz::BinaryFile bf("checksum_test.bin");
+	bf.enable_checksum(zz::Checksum::XXH64);
+	int v;
+	while (bf.read(v))
+	{
+	}
+	Println("Checksum while reading: " << bf.checksum() << " of " << bf.checksum_size() << " bytes, time: "
+		<< t.get_elapsed_time_ms() << "ms");
+	t.update();
+	Println("hash_file: " << zz::hash_file("checksum_test.bin") << ", time: " << t.get_elapsed_time_ms() << "ms");
+	std::remove("checksum_test.bin");
+}
+
+void test_mapped_array()
+{
+	Println("\nTesting mapped array\n");
+	{
+		zz::BinaryFile bf("mapped_array.bin", std::ios::in | std::ios::out | std::ios::trunc);
+		for (int i = 0; i < 1000000; i++)
+		{
+			bf.write(static_cast<float>(i));
+		}
+
+		zz::MappedArray<float> rw;
+		Println("Mapped read-write: " << bf.map(rw, 1));
+		rw[0] = -1.f;
+		rw.sync();
+	}
+
+	zz::MappedArray<float> arr("mapped_array.bin");
+	arr.advise(zz::FileMap::RANDOM);
+	arr.prefault();
+	Println("Elements: " << arr.size() << ", first: " << arr[0] << ", last: " << arr.at(arr.size() - 1));
+	try
+	{
+		arr.at(arr.size());
+	}
+	catch (const zz::ArgException &ex)
+	{
+		Println(ex.what() << " catched!");
+	}
+	arr.close();
+	std::remove("mapped_array.bin");
+}
+
+void test_mapped_writer()
+{
+	Println("\nTesting mapped writer\n");
+	zz::Timer t;
+	{
+		zz::MappedWriter out("mapped_writer.bin", 16 * 1024 * 1024);
+		for (int i = 0; i < 10000000; i++)
+		{
+			out.write(i);
+		}
+		Println("Written " << out.size() << " bytes, mapped " << out.capacity() << ", time: " << t.get_elapsed_time_ms() << "ms");
+	}
+
+	zz::MappedArray<int> arr("mapped_writer.bin");
+	Println("Elements: " << arr.size() << ", last: " << arr[arr.size() - 1]);
+	arr.close();
+	std::remove("mapped_writer.bin");
+}
+
+void test_async_read()
+{
+	Println("\nTesting asynchronous reads\n");
+	const size_t n = 4 * 1024 * 1024;
+	{
+		std::vector<int> values(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			values[i] = static_cast<int>(i);
+		}
+		zz::BinaryFile bf("async_read.bin", std::ios::out);
+		bf.write(&values.front(), n);
+	}
+
+	zz::BinaryFile bf("async_read.bin");
+	zz::AsyncReader reader;
+	Println("Opened: " << bf.open_async(reader, 64) << ", io_uring: " << reader.is_uring());
+
+	const size_t numReads = 10000;
+	std::vector<int> buf(numReads);
+	std::vector<zz::AsyncRead> reads(numReads);
+	for (size_t i = 0; i < numReads; i++)
+	{
+		reads[i] = zz::AsyncRead((rand() % n) * sizeof(int), &buf[i], sizeof(int));
+	}
+
+	zz::Timer t;
+	reader.submit(&reads.front(), reads.size());
+	std::vector<zz::AsyncRead*> done(256);
+	size_t ok = 0;
+	while (reader.pending() > 0)
+	{
+		size_t ct = reader.wait(&done.front(), done.size());
+		for (size_t i = 0; i < ct; i++)
+		{
+			const int *value = static_cast<const int*>(done[i]->data);
+			ok += (done[i]->error == 0 && static_cast<uint64>(*value) * sizeof(int) == done[i]->offset);
+		}
+	}
+	Println(ok << "/" << numReads << " reads correct in " << t.get_elapsed_time_ms() << "ms");
+	reader.close();
+	std::remove("async_read.bin");
+}
+
+struct TestRecord
+{
+	double	value;
+	int		id;
+	int		flag;
+};
+
+void test_record_file()
+{
+	Println("\nTesting record file\n");
+	std::remove("records.rec");
+	zz::Timer t;
+	{
+		zz::RecordFile<TestRecord> rf("records.rec", 1, 10000);
+		for (int i = 0; i < 100000; i++)
+		{
+			TestRecord rec = { i * 0.5, i, 0 };
+			rf.append(rec);
+		}
+		Println("Appended " << rf.size() << " records in " << t.get_elapsed_time_ms() << "ms");
+	}
+
+	zz::RecordFile<TestRecord> rf("records.rec", 0);
+	Println("Reopened, committed: " << rf.committed());
+	Println("Record 4242: " << rf.get(4242).value);
+	TestRecord range[4];
+	rf.get_range(99996, 4, range);
+	Println("Last id: " << range[3].id);
+	std::remove("records.rec");
+}
+
+void test_block_file()
+{
+	Println("\nTesting block compressed file\n");
+	String data;
+	for (int i = 0; i < 1000000; i++)
+	{
+		data += TO_STRING(i << ",event_" << i % 100 << "\n");
+	}
+
+	zz::Timer t;
+	{
+		zz::BlockFileWriter writer("block_test.blk", 256 * 1024);
+		writer.write(data.data(), data.size());
+		writer.close();
+		Println("Compressed " << writer.size() << " to " << writer.compressed_size()
+			<< " bytes in " << t.get_elapsed_time_ms() << "ms");
+	}
+
+	zz::BlockFileReader reader("block_test.blk");
+	std::vector<char> buf(data.size());
+	t.update();
+	size_t n = reader.read(0, &buf.front(), buf.size());
+	Println("Read " << n << " bytes in " << reader.num_blocks() << " blocks, match: "
+		<< (String(&buf.front(), n) == data) << ", time: " << t.get_elapsed_time_ms() << "ms");
+
+	n = reader.read(1234567, &buf.front(), 20);
+	Println("Range at 1234567: " << String(&buf.front(), n));
+
+	// point block 1 at the data of block 4, the reader has to refuse the file
+	{
+		std::fstream fs("block_test.blk", std::ios::in | std::ios::out | std::ios::binary);
+		uint64 footer[4];
+		fs.seekg(-40, std::ios::end);
+		fs.read(reinterpret_cast<char*>(footer), sizeof(footer));
+		uint64 offset4;
+		fs.seekg(static_cast<std::streamoff>(footer[3] + 4 * 32));
+		fs.read(reinterpret_cast<char*>(&offset4), sizeof(offset4));
+		fs.seekp(static_cast<std::streamoff>(footer[3] + 1 * 32));
+		fs.write(reinterpret_cast<const char*>(&offset4), sizeof(offset4));
+	}
+	try
+	{
+		zz::BlockFileReader tampered("block_test.blk");
+		n = tampered.read(0, &buf.front(), 3 * 4096);
+		Println("Tampered file accepted!");
+	}
+	catch (const zz::IOException &e)
+	{
+		Println("Tampered file rejected: " << e.what());
+	}
+	std::remove("block_test.blk");
+}
+
+void group_commit_worker(void *arg)
+{
+	zz::GroupCommitWriter &log = *static_cast<zz::GroupCommitWriter*>(arg);
+	for (int i = 0; i < 1000; i++)
+	{
+		char rec[64] = "record\n";
+		log.commit(rec, sizeof(rec));
+	}
+}
+
+void test_group_commit()
+{
+	Println("\nTesting group commit writer\n");
+	std::remove("group_commit.log");
+	zz::Timer t;
+	{
+		zz::GroupCommitWriter log("group_commit.log", 2);
+		zz::Thread threads[8];
+		for (int i = 0; i < 8; i++)
+		{
+			threads[i].start(group_commit_worker, &log);
+		}
+		for (int i = 0; i < 8; i++)
+		{
+			threads[i].join();
+		}
+	}
+	Println("8000 durable records in " << t.get_elapsed_time_ms() << "ms, file size: "
+		<< zz::BinaryFile("group_commit.log").size());
+	std::remove("group_commit.log");
+}
+
+// byte by byte loop, as count_lines() did before the SIMD kernel
+size_t count_newlines_naive(const char *data, size_t len)
+{
+	size_t ct = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		if (data[i] == '\n')
+		{
+			ct++;
+		}
+	}
+	return ct;
+}
+
+void test_count_lines_bench()
+{
+	Println("\nBenchmark newline counting\n");
+	const char *path = "count_lines_bench.txt";
+	const uint64 fileSize = 4ULL << 30; // 4GB
+
+	// generate lines of varying length
+	{
+		String block;
+		for (int i = 0; block.size() < (1 << 20); i++)
+		{
+			block.append(String(i % 120, 'x'));
+			block.push_back('\n');
+		}
+		std::ofstream out(path, std::ios::out | std::ios::binary);
+		for (uint64 written = 0; written < fileSize; written += block.size())
+		{
+			out.write(block.data(), block.size());
+		}
+	}
+
+	{
+		zz::TextFile tf(path, std::ios::in, 1);
+		zz::FileMap fm;
+		if (!fm.map(path))
+		{
+			Println("Failed to map " << path);
+			return;
+		}
+		const double size = fm.size() / 1e9;
+		count_newlines_naive(fm.data(), fm.size()); // warm up page cache
+
+		zz::Timer t;
+		size_t ct = count_newlines_naive(fm.data(), fm.size());
+		double s = t.get_elapsed_time_s();
+		Println("Naive loop: " << ct << " lines, " << size / s << " GB/s");
+
+		t.update();
+		ct = zz::count_newlines(fm.data(), fm.size());
+		s = t.get_elapsed_time_s();
+		Println("SIMD kernel: " << ct << " lines, " << size / s << " GB/s");
+
+		t.update();
+		int lines = tf.count_lines();
+		s = t.get_elapsed_time_s();
+		Println("Mapped count_lines: " << lines << " lines, " << size / s << " GB/s");
+
+		zz::TextFile ts(path);
+		t.update();
+		lines = ts.count_lines();
+		s = t.get_elapsed_time_s();
+		Println("Stream count_lines: " << lines << " lines, " << size / s << " GB/s");
+
+		const int threads = zz::Thread::hardware_concurrency();
+		t.update();
+		lines = ts.count_lines(threads);
+		s = t.get_elapsed_time_s();
+		Println("Parallel count_lines(" << threads << "): " << lines << " lines, " << size / s << " GB/s");
+	}
+
+	std::remove(path);
+}
+
 String put_match(bool ret)
 {
 	return ret ? String("Yes") : String("No");
@@ -141,6 +669,161 @@ void test_dir()
 	Println(zz::Dir::mk_dir("../../newfolder/newfolder2/newfolder3"));
 }
 
+void test_wildcard_pattern()
+{
+	Println("\nTesting compiled wildcard pattern\n");
+	zz::WildcardPattern jpg("*.JPG", 0);
+	Println(put_match(jpg.match("owjfsdlfjl.jpg")));
+	Println(put_match(jpg.match("folder/image.Jpg")));
+	Println(put_match(jpg.match("image.jpeg")));
+	Println(put_match(zz::WildcardPattern("ge?ks**for*").match("geeksforgeeks")));
+
+	// the backtracking matcher used to take exponential time on this
+	String name(100000, 'a');
+	zz::WildcardPattern slow("*a*a*a*a*a*a*a*a*a*b*");
+	zz::Timer t;
+	Println(put_match(slow.match(name)) << " in " << t.get_elapsed_time_ms() << "ms");
+
+	Vecstr wildcards;
+	wildcards.push_back("*.HPP");
+	wildcards.push_back("*.cpp");
+	Vecstr files = zz::Dir("../../src").list_files(wildcards);
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		Println(files[i]);
+	}
+}
+
+void make_synthetic_tree(const String &root, int depth, int fanout, int filesPerFolder)
+{
+	zz::Dir::mk_dir(root);
+	if (depth == 0)
+	{
+		for (int i = 0; i < filesPerFolder; i++)
+		{
+			FILE *fp = fopen(TO_STRING(root << "/file_" << i << ".dat").c_str(), "w");
+			if (fp)
+				fclose(fp);
+		}
+		return;
+	}
+	for (int i = 0; i < fanout; i++)
+	{
+		make_synthetic_tree(TO_STRING(root << "/folder_" << i), depth - 1, fanout, filesPerFolder);
+	}
+}
+
+void test_dir_tree()
+{
+	Println("\nTesting directory tree with 1M files\n");
+	// 2^12 leaf folders with 244 files each, deep trees used to cost the most
+	const String root = "dir_tree_test";
+	zz::Timer t;
+	make_synthetic_tree(root, 12, 2, 244);
+	Println("Tree created in " << t.get_elapsed_time_ms() << "ms");
+
+	for (int i = 0; i < 3; i++)
+	{
+		t.update();
+		zz::Dir dir(root, 1);
+		double buildTime = t.get_elapsed_time_ms();
+		t.update();
+		Vecstr files = dir.list_files();
+		Println("Build: " << buildTime << "ms, list: " << t.get_elapsed_time_ms() << "ms, files: " << files.size());
+	}
+
+#if ZULIB_OS == 0
+	zz::system(("rmdir /s /q " + root).c_str());
+#elif ZULIB_OS == 1
+	zz::system(("rm -rf " + root).c_str());
+#endif
+	Println("Tree removed: " << (zz::Path::is_exist(root) < 1));
+}
+
+void count_walked(const Vecstr &files, void *context)
+{
+	*static_cast<size_t*>(context) += files.size();
+}
+
+void test_walk_parallel()
+{
+	Println("\nTesting parallel directory walk\n");
+	for (int threads = 1; threads <= 8; threads *= 2)
+	{
+		size_t count = 0;
+		zz::Timer t;
+		size_t n = zz::Dir::walk_parallel("../../", threads, count_walked, &count);
+		Println("Threads: " << threads << ", files: " << n << ", delivered: " << count << ", time: " << t.get_elapsed_time_ms() << "ms");
+	}
+	Println("Dir: " << zz::Dir("../../", 1).list_files().size() << " files");
+}
+
+void test_dir_iterator()
+{
+	Println("\nTesting lazy directory iterator\n");
+	zz::Timer t;
+	size_t files = 0, folders = 0;
+	for (zz::DirIterator it("../../"); !it.end(); it.next())
+	{
+		if (files + folders == 0)
+			Println("First entry: " << it.path() << " after " << t.get_elapsed_time_ms() << "ms");
+
+		if (it.is_directory())
+		{
+			folders++;
+			// do not walk into the build outputs
+			if (it.name() == "build")
+				it.skip_subtree();
+		}
+		else
+			files++;
+	}
+	Println("Files: " << files << ", folders: " << folders << ", time: " << t.get_elapsed_time_ms() << "ms");
+}
+
+void test_dir_read_buffer()
+{
+	Println("\nTesting directory read buffer sizes\n");
+	const size_t sizes[] = { 4096, 32 * 1024, 256 * 1024, 4 * 1024 * 1024 };
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		zz::Dir::set_read_buffer_size(sizes[i]);
+		zz::Timer t;
+		size_t n = zz::Dir("../../", 1, 1).list_files().size();
+		Println("Buffer: " << zz::Dir::read_buffer_size() << " bytes, files: " << n << ", time: " << t.get_elapsed_time_ms() << "ms");
+	}
+	zz::Dir::set_read_buffer_size(256 * 1024);
+}
+
+void test_copy_file()
+{
+	Println("\nTesting file copy\n");
+	zz::Timer t;
+	size_t n = zz::copy_tree("../../src", "copy_test/src", 4);
+	Println("Copied " << n << " files in " << t.get_elapsed_time_ms() << "ms");
+
+	Println("Copied bytes: " << zz::copy_file("../../LICENSE", "copy_test/LICENSE", 1));
+	zz::move_file("copy_test/LICENSE", "copy_test/LICENSE.moved");
+	Println("Moved: " << (zz::Path::is_exist("copy_test/LICENSE.moved") == 1));
+
+	// backup files and links are copied as they are, not filtered or followed
+	zz::Dir::mk_dir("copy_test/tree/sub");
+	std::ofstream("copy_test/tree/notes~") << "backup";
+	std::ofstream("copy_test/tree/sub/file.txt") << "data";
+#if ZULIB_OS == 1
+	zz::system("ln -s sub copy_test/tree/dirlink && ln -s missing copy_test/tree/dangling");
+#endif
+	n = zz::copy_tree("copy_test/tree", "copy_test/tree_copy");
+	Println("Copied " << n << " entries, backup: " << (zz::Path::is_exist("copy_test/tree_copy/notes~") == 1)
+		<< ", through link: " << (zz::Path::is_exist("copy_test/tree_copy/dirlink/file.txt") == 1));
+
+#if ZULIB_OS == 0
+	zz::system("rmdir /s /q copy_test");
+#elif ZULIB_OS == 1
+	zz::system("rm -rf copy_test");
+#endif
+}
+
 void test_progbar()
 {
 	Println("Testing progress bar!");
@@ -181,7 +864,31 @@ int main()
 {
 	//test_time();
 	//test_file();
+	//test_mapped_file();
+	//test_count_lines_bench();
+	//test_line_index();
+	//test_line_ref();
+	//test_line_batch();
+	//test_delimited();
+	//test_follow();
+	//test_compressed();
+	//test_binary_file();
+	//test_direct_io();
+	//test_checksum();
+	//test_mapped_array();
+	//test_mapped_writer();
+	//test_async_read();
+	//test_record_file();
+	//test_block_file();
+	//test_group_commit();
+	//test_prefetch();
 	//test_dir();
+	//test_copy_file();
+	//test_dir_tree();
+	//test_walk_parallel();
+	//test_dir_iterator();
+	//test_dir_read_buffer();
+	//test_wildcard_pattern();
 	//test_msg();
 	//test_progbar();
 	///test_exception();
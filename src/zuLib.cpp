@@ -21,6 +21,8 @@
 #include <algorithm>
 #include <cctype>
 #include <cstring>
+#include <cerrno>
+#include <deque>
 
 
 
@@ -29,6 +31,11 @@
 #include <direct.h>
 #include <conio.h>
 #include <io.h>
+#include <process.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #elif ZULIB_OS == 1
 
 // Apple Mac_OS_X specific
@@ -47,7 +54,57 @@
 #include <termios.h>
 #include <string.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#define ZULIB_INOTIFY
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+// io_uring through raw system calls, the headers only need to know the ABI
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__GNUC__)
+#define ZULIB_IO_URING
+#endif
+#endif
+#endif
+#endif
+
+#endif
+
+// x86 SIMD kernels, AVX2 is compiled per function and selected at runtime
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ZULIB_SSE2
+#if (defined(__GNUC__) && ((__GNUC__ == 4 && __GNUC_MINOR__ >= 9) || __GNUC__ > 4)) || defined(__clang__)
+#include <immintrin.h>
+#define ZULIB_AVX2
+#define ZULIB_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#define ZULIB_TARGET_SSE42 __attribute__((target("sse4.2")))
+#elif defined(_MSC_VER) && _MSC_VER >= 1700
+#include <immintrin.h>
+#include <intrin.h>
+#define ZULIB_AVX2
+#define ZULIB_TARGET_AVX2
+#define ZULIB_TARGET_SSE42
+#endif
+// the 64-bit crc32 instruction only exists in 64-bit mode
+#if defined(ZULIB_AVX2) && (defined(__x86_64__) || defined(_M_X64))
+#define ZULIB_SSE42
+#endif
+#endif
 
+// zlib is optional, the build defines ZULIB_HAVE_ZLIB when it is found
+#ifdef ZULIB_HAVE_ZLIB
+#include <zlib.h>
 #endif
 
 
@@ -411,16 +468,199 @@ namespace zz
 	}
 
 
+	// ------------------------------- Thread -----------------------------------//
+	struct ThreadEntry
+	{
+#if ZULIB_OS == 0
+		static unsigned __stdcall entry(void *self)
+		{
+			Thread::run(static_cast<Thread*>(self));
+			return 0;
+		}
+#else
+		static void* entry(void *self)
+		{
+			Thread::run(static_cast<Thread*>(self));
+			return NULL;
+		}
+#endif
+	};
+
+	void Thread::start(Func func, void *arg)
+	{
+		if (handle_ != NULL)
+			throw RuntimeException("Thread already started!");
+
+		func_ = func;
+		arg_ = arg;
+#if ZULIB_OS == 0
+		uintptr_t h = _beginthreadex(NULL, 0, ThreadEntry::entry, this, 0, NULL);
+		if (h == 0)
+			throw RuntimeException("Failed to create thread!");
+		handle_ = reinterpret_cast<void*>(h);
+#else
+		pthread_t *tid = new pthread_t;
+		if (pthread_create(tid, NULL, ThreadEntry::entry, this) != 0)
+		{
+			delete tid;
+			throw RuntimeException("Failed to create thread!");
+		}
+		handle_ = tid;
+#endif
+	}
+
+	void Thread::join()
+	{
+		if (handle_ == NULL)
+			return;
+#if ZULIB_OS == 0
+		WaitForSingleObject(static_cast<HANDLE>(handle_), INFINITE);
+		CloseHandle(static_cast<HANDLE>(handle_));
+#else
+		pthread_t *tid = static_cast<pthread_t*>(handle_);
+		pthread_join(*tid, NULL);
+		delete tid;
+#endif
+		handle_ = NULL;
+	}
+
+	int Thread::hardware_concurrency()
+	{
+#if ZULIB_OS == 0
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return max(static_cast<int>(info.dwNumberOfProcessors), 1);
+#elif defined(_SC_NPROCESSORS_ONLN)
+		return max(static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)), 1);
+#else
+		return 1;
+#endif
+	}
+
+	Mutex::Mutex()
+	{
+#if ZULIB_OS == 0
+		CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+		InitializeCriticalSection(cs);
+		handle_ = cs;
+#else
+		pthread_mutex_t *m = new pthread_mutex_t;
+		pthread_mutex_init(m, NULL);
+		handle_ = m;
+#endif
+	}
+
+	Mutex::~Mutex()
+	{
+#if ZULIB_OS == 0
+		DeleteCriticalSection(static_cast<CRITICAL_SECTION*>(handle_));
+		delete static_cast<CRITICAL_SECTION*>(handle_);
+#else
+		pthread_mutex_destroy(static_cast<pthread_mutex_t*>(handle_));
+		delete static_cast<pthread_mutex_t*>(handle_);
+#endif
+	}
+
+	void Mutex::lock()
+	{
+#if ZULIB_OS == 0
+		EnterCriticalSection(static_cast<CRITICAL_SECTION*>(handle_));
+#else
+		pthread_mutex_lock(static_cast<pthread_mutex_t*>(handle_));
+#endif
+	}
+
+	void Mutex::unlock()
+	{
+#if ZULIB_OS == 0
+		LeaveCriticalSection(static_cast<CRITICAL_SECTION*>(handle_));
+#else
+		pthread_mutex_unlock(static_cast<pthread_mutex_t*>(handle_));
+#endif
+	}
+
+	CondVar::CondVar()
+	{
+#if ZULIB_OS == 0
+		CONDITION_VARIABLE *cv = new CONDITION_VARIABLE;
+		InitializeConditionVariable(cv);
+		handle_ = cv;
+#else
+		pthread_cond_t *cv = new pthread_cond_t;
+		pthread_cond_init(cv, NULL);
+		handle_ = cv;
+#endif
+	}
+
+	CondVar::~CondVar()
+	{
+#if ZULIB_OS == 0
+		delete static_cast<CONDITION_VARIABLE*>(handle_);
+#else
+		pthread_cond_destroy(static_cast<pthread_cond_t*>(handle_));
+		delete static_cast<pthread_cond_t*>(handle_);
+#endif
+	}
+
+	void CondVar::wait(Mutex &mutex)
+	{
+#if ZULIB_OS == 0
+		SleepConditionVariableCS(static_cast<CONDITION_VARIABLE*>(handle_),
+			static_cast<CRITICAL_SECTION*>(mutex.handle_), INFINITE);
+#else
+		pthread_cond_wait(static_cast<pthread_cond_t*>(handle_), static_cast<pthread_mutex_t*>(mutex.handle_));
+#endif
+	}
+
+	bool CondVar::wait(Mutex &mutex, int timeoutMs)
+	{
+#if ZULIB_OS == 0
+		return SleepConditionVariableCS(static_cast<CONDITION_VARIABLE*>(handle_),
+			static_cast<CRITICAL_SECTION*>(mutex.handle_), static_cast<DWORD>(max(timeoutMs, 0))) != 0;
+#else
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		const long long usec = static_cast<long long>(now.tv_usec) + static_cast<long long>(max(timeoutMs, 0)) * 1000;
+		struct timespec deadline;
+		deadline.tv_sec = now.tv_sec + static_cast<time_t>(usec / 1000000);
+		deadline.tv_nsec = static_cast<long>(usec % 1000000) * 1000;
+		return pthread_cond_timedwait(static_cast<pthread_cond_t*>(handle_),
+			static_cast<pthread_mutex_t*>(mutex.handle_), &deadline) != ETIMEDOUT;
+#endif
+	}
+
+	void CondVar::notify_one()
+	{
+#if ZULIB_OS == 0
+		WakeConditionVariable(static_cast<CONDITION_VARIABLE*>(handle_));
+#else
+		pthread_cond_signal(static_cast<pthread_cond_t*>(handle_));
+#endif
+	}
+
+	void CondVar::notify_all()
+	{
+#if ZULIB_OS == 0
+		WakeAllConditionVariable(static_cast<CONDITION_VARIABLE*>(handle_));
+#else
+		pthread_cond_broadcast(static_cast<pthread_cond_t*>(handle_));
+#endif
+	}
+
 	BaseFile::BaseFile()
+		: checksum_(Checksum::NONE)
 	{
 		this->flag_ = INIT;
 		this->openmode_ = std::ios::in;
+		this->codec_ = Decompressor::NONE;
 	}
 
 	BaseFile::BaseFile(String file, std::ios_base::openmode openmode)
+		: checksum_(Checksum::NONE)
 	{
 
 		flag_ = INIT;
+		codec_ = Decompressor::NONE;
 
 		// detect if file exists
 		if (Path::is_directory(file) == 0)
@@ -463,637 +703,5860 @@ namespace zz
 			throw IOException(TO_STRING("Failed to open file: " << path_));
 	}
 
-	TextFile::TextFile()
+	void BaseFile::enable_decompression()
 	{
+		if (openmode_ & std::ios_base::out)
+			return;
 
-	}
-
-	int TextFile::count_lines()
-	{
-		std::ifstream fread(path_.c_str());
-		if (!fread.is_open())
-		{
-			throw IOException("Failed to open file to count lines.");
-			return -1;
-		}
+		codec_ = Decompressor::detect(path_);
+		if (codec_ == Decompressor::NONE)
+			return;
 
-		const int bufSize = 1024 * 1024;	// using 1MB buffer
-		std::vector<char> buf(bufSize);
+		if (!Decompressor::is_supported(codec_))
+			throw IOException(TO_STRING("Unsupported compressed file: " << path_));
 
-		int ct = 0;
-		int nbuf = 0;
-		char last = 0;
-		do
+		// compressed data must not go through text mode translation
+		if (!(openmode_ & std::ios_base::binary))
 		{
-			fread.read(&buf.front(), bufSize);
-			nbuf = static_cast<int>(fread.gcount());
-			for (int i = 0; i < nbuf; i++)
-			{
-				last = buf[i];
-				if (last == '\n')
-				{
-					ct++;
-				}
-			}
-		} while (nbuf > 0);
+			fp_.close();
+			openmode_ |= std::ios_base::binary;
+			open();
+		}
+		decoder_.open(&fp_, codec_);
+	}
 
-		if (last != '\n')
-			ct++;
+	size_t BaseFile::read_stream(char *dst, size_t len)
+	{
+		if (codec_ != Decompressor::NONE)
+			return decoder_.read(dst, len);
 
-		return ct;
+		fp_.read(dst, static_cast<std::streamsize>(len));
+		return static_cast<size_t>(fp_.gcount());
 	}
 
-
-	int TextFile::next_line(String &line)
+	void BaseFile::seek_stream(uint64 offset)
 	{
-		if (!fp_.good() || !fp_.is_open())
-			return -1;
-
-		if (!fp_.eof())
+		fp_.clear();
+		if (codec_ == Decompressor::NONE)
 		{
-			std::getline(fp_, line);
-			if (!line.empty())
-			{
-				return static_cast<int>(line.length());
-			}
+			fp_.seekg(static_cast<std::streamoff>(offset));
+			return;
 		}
 
-		return 0;
+		// no random access into compressed data, decode again from the beginning
+		fp_.seekg(0);
+		decoder_.open(&fp_, codec_);
+		decoder_.skip(offset);
 	}
 
+	void BaseFile::add_checksum(uint64 offset, const char *data, size_t len)
+	{
+		const uint64 end = checksum_.size();
+		if (checksum_.type() != Checksum::NONE && offset <= end && offset + len > end)
+			checksum_.update(data + (end - offset), static_cast<size_t>(offset + len - end));
+	}
 
-	int TextFile::goto_line(int n)
+	namespace
 	{
-		if (!fp_.good() || !fp_.is_open())
-			return -1;
+		size_t count_newlines_scalar(const char *data, size_t len)
+		{
+			size_t ct = 0;
+			for (size_t i = 0; i < len; i++)
+			{
+				ct += (data[i] == '\n');
+			}
+			return ct;
+		}
 
-		fp_.seekg(std::ios::beg);
+#ifdef ZULIB_SSE2
+		size_t count_newlines_sse2(const char *data, size_t len)
+		{
+			const __m128i nl = _mm_set1_epi8('\n');
+			const __m128i zero = _mm_setzero_si128();
+			size_t ct = 0;
+			size_t i = 0;
+			while (i + 16 <= len)
+			{
+				// byte counters, flushed before any of them could overflow
+				__m128i acc = _mm_setzero_si128();
+				size_t blocks = (len - i) / 16;
+				if (blocks > 255) blocks = 255;
+				for (size_t b = 0; b < blocks; b++, i += 16)
+				{
+					__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+					acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, nl));
+				}
+				__m128i sum = _mm_sad_epu8(acc, zero);
+				ct += static_cast<size_t>(_mm_cvtsi128_si32(sum)) + static_cast<size_t>(_mm_extract_epi16(sum, 4));
+			}
+			return ct + count_newlines_scalar(data + i, len - i);
+		}
+#endif
 
-		if (n < 0)
+#ifdef ZULIB_AVX2
+		ZULIB_TARGET_AVX2 size_t count_newlines_avx2(const char *data, size_t len)
 		{
-			Warning("n < 0, seek back to the first line");
-			return 0;
+			const __m256i nl = _mm256_set1_epi8('\n');
+			size_t ct = 0;
+			size_t i = 0;
+			// 64 bytes per step, two compare masks merged for a single popcount
+			for (; i + 64 <= len; i += 64)
+			{
+				__m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				__m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+				uint64 m0 = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v0, nl)));
+				uint64 m1 = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v1, nl)));
+#if defined(_MSC_VER) && defined(_M_X64)
+				ct += static_cast<size_t>(__popcnt64(m0 | (m1 << 32)));
+#elif defined(_MSC_VER)
+				ct += __popcnt(static_cast<unsigned int>(m0)) + __popcnt(static_cast<unsigned int>(m1));
+#else
+				ct += static_cast<size_t>(__builtin_popcountll(m0 | (m1 << 32)));
+#endif
+			}
+			return ct + count_newlines_scalar(data + i, len - i);
 		}
 
-		if (n == 0)
+		bool cpu_has_avx2()
 		{
-			return 0;
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7)
+				return false;
+			__cpuid(info, 1);
+			// OS must save YMM registers on context switch
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool popcnt = (info[2] & (1 << 23)) != 0;
+			if (!osxsave || !popcnt || (_xgetbv(0) & 6) != 6)
+				return false;
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#endif
 		}
+#endif
 
-		int i = 0;
-		for (i = 0; i < n - 1; ++i)
+		typedef size_t(*CountNewlinesFunc)(const char*, size_t);
+
+		CountNewlinesFunc select_count_newlines()
 		{
+#ifdef ZULIB_AVX2
+			if (cpu_has_avx2())
+				return count_newlines_avx2;
+#endif
+#ifdef ZULIB_SSE2
+			return count_newlines_sse2;
+#else
+			return count_newlines_scalar;
+#endif
+		}
+	}
+
+	size_t count_newlines(const char *data, size_t len)
+	{
+		// resolved once, racing threads would store the same value
+		static CountNewlinesFunc func = NULL;
+		if (func == NULL)
+			func = select_count_newlines();
+		return func(data, len);
+	}
 
-			fp_.ignore((std::numeric_limits<std::streamsize>::max)(), '\n');
+	const char* skip_newlines(const char *data, size_t len, size_t n)
+	{
+		if (n == 0)
+			return data;
 
-			if (fp_.eof())
-			{
-				Warning("Reached end of file, line: " << (i + 1));
+		const size_t chunk = 4096;
+		const char *p = data;
+		const char *end = data + len;
+
+		// jump over whole chunks which can not contain the n-th newline
+		while (static_cast<size_t>(end - p) > chunk)
+		{
+			size_t ct = count_newlines(p, chunk);
+			if (ct >= n)
 				break;
-			}
+			n -= ct;
+			p += chunk;
 		}
 
-		return i+1;
+		while (p < end)
+		{
+			p = static_cast<const char*>(memchr(p, '\n', end - p));
+			if (p == NULL)
+				return NULL;
+			p++;
+			if (--n == 0)
+				return p;
+		}
+		return NULL;
 	}
 
-	BinaryFile::BinaryFile()
+	bool FileMap::map(const String &path, int writable, int advice)
 	{
-		openmode_ |= std::ios_base::binary;
-	}
+		unmap();
 
+#if ZULIB_OS == 0
+		// the cache manager reads ahead by the hint given when the file is opened
+		DWORD flags = FILE_ATTRIBUTE_NORMAL;
+		if (advice == SEQUENTIAL)
+			flags = FILE_FLAG_SEQUENTIAL_SCAN;
+		else if (advice == RANDOM)
+			flags = FILE_FLAG_RANDOM_ACCESS;
+		HANDLE hFile = CreateFileA(path.c_str(), writable > 0 ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+			FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, flags, NULL);
+		if (hFile == INVALID_HANDLE_VALUE)
+			return false;
 
+		// only disk files can be mapped
+		LARGE_INTEGER fsize;
+		if (GetFileType(hFile) != FILE_TYPE_DISK || !GetFileSizeEx(hFile, &fsize)
+			|| (uint64)fsize.QuadPart > (uint64)((std::numeric_limits<size_t>::max)()))
+		{
+			CloseHandle(hFile);
+			return false;
+		}
 
-	String Path::get_cwd()
-	{
-#ifdef _WIN32
-		char* buffer = NULL;
-		if ((buffer = _getcwd(NULL, 0)) == NULL)
+		size_ = static_cast<size_t>(fsize.QuadPart);
+		if (size_ > 0)
 		{
-			throw IOException("Failed to get current working directory, try use default './' instead");
-			return String("./");
+			// the view keeps the mapping alive, so both handles can be closed right away
+			HANDLE hMap = CreateFileMappingA(hFile, NULL, writable > 0 ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+			if (hMap != NULL)
+			{
+				addr_ = MapViewOfFile(hMap, writable > 0 ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(hMap);
+			}
 		}
-		else
+		CloseHandle(hFile);
+
+		if (size_ > 0 && addr_ == NULL)
 		{
-			String ret(buffer);
-			free(buffer);
-			return reform(ret);
+			size_ = 0;
+			return false;
 		}
-#else
-#ifdef _PC_PATH_MAX
-		long size;
-		char *buf = NULL;
-		char *ptr = NULL;
+#elif ZULIB_OS == 1
+		int fd = ::open(path.c_str(), writable > 0 ? O_RDWR : O_RDONLY);
+		if (fd < 0)
+			return false;
 
-		size = pathconf(".", _PC_PATH_MAX);
-		if ((buf = (char *)malloc((size_t)size)) != NULL)
+		// pipes, sockets and devices are left to stream IO
+		struct stat sb;
+		if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode)
+			|| (uint64)sb.st_size > (uint64)((std::numeric_limits<size_t>::max)()))
 		{
-			ptr = getcwd(buf, (size_t)size);
+			::close(fd);
+			return false;
 		}
 
-		if (ptr)
+		size_ = static_cast<size_t>(sb.st_size);
+		if (size_ > 0)
 		{
-			String ret(ptr);
-			free(buf);
-			return ret;
+			void *addr = mmap(NULL, size_, writable > 0 ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+			addr_ = (addr == MAP_FAILED) ? NULL : addr;
 		}
-		else
+		// mapping stays valid after the descriptor is closed
+		::close(fd);
+
+		if (size_ > 0 && addr_ == NULL)
 		{
-			throw IOException("Failed to get current working directory, try use default './' instead");
-			return String("./");
+			size_ = 0;
+			return false;
 		}
 #else
-		// rarely happens, but in this case you need to preallocate memory 
-		// and increase if buffer is not large enough
-		size_t bufSize = 1024;
-		const size_t maxBufSize = 8192;
-		char* buf = NULL;
-		char* rBuf;
+		return false;
+#endif
 
-		do 
+		mapped_ = true;
+		writable_ = writable > 0;
+		if (advice != NORMAL)
+			advise(advice);
+		return true;
+	}
+
+	void FileMap::unmap()
+	{
+		if (addr_ != NULL)
 		{
-			buf = static_cast<char*>(realloc(buf, bufSize));
-			rBuf = getcwd(buf, bufSize);
-			if (!rBuf) 
-			{
-				if (errno == ERANGE) 
-				{
-					bufSize *= 2;
-					if (bufSize > maxBufSize)
-					{
-						free(buf);
-						break;
-					}
-				} 
-				else 
-				{
-					free(buf);
-					break;
-				}
-			}
-			else
-			{
-				String ret(buf);
-				free(buf);
-				return ret;
-			}
-		} while (!rBuf);
+#if ZULIB_OS == 0
+			UnmapViewOfFile(addr_);
+#elif ZULIB_OS == 1
+			munmap(addr_, size_);
+#endif
+		}
+		addr_ = NULL;
+		size_ = 0;
+		mapped_ = writable_ = false;
+	}
 
-		
-		throw IOException("Failed to get current working directory, try use default './' instead");
-		return String("./");
+	void FileMap::advise(int advice)
+	{
+#if ZULIB_OS == 1 && defined(MADV_SEQUENTIAL)
+		if (addr_ == NULL)
+			return;
 
+		int adv = MADV_NORMAL;
+		if (advice == SEQUENTIAL) adv = MADV_SEQUENTIAL;
+		else if (advice == RANDOM) adv = MADV_RANDOM;
+		else if (advice == WILLNEED) adv = MADV_WILLNEED;
+#ifdef MADV_HUGEPAGE
+		else if (advice == HUGEPAGE) adv = MADV_HUGEPAGE;
+#else
+		else if (advice == HUGEPAGE) return;
 #endif
+		madvise(addr_, size_, adv);
+#else
+		unused(advice);
+#endif
+	}
+
+	void FileMap::prefault()
+	{
+		if (addr_ == NULL)
+			return;
 
+#if ZULIB_OS == 1 && defined(MADV_POPULATE_READ)
+		// populate page tables in one call, writable mappings without write faults later
+		if (madvise(addr_, size_, writable_ ? MADV_POPULATE_WRITE : MADV_POPULATE_READ) == 0)
+			return;
 #endif
+		// touch one byte per page
+		const volatile char *p = static_cast<const volatile char*>(addr_);
+		char sum = 0;
+		for (size_t i = 0; i < size_; i += 4096)
+		{
+			sum ^= p[i];
+		}
+		unused(sum);
 	}
 
+	bool FileMap::sync()
+	{
+		if (addr_ == NULL || !writable_)
+			return true;
 
-	String Path::get_real_path(String relativePath)
+#if ZULIB_OS == 0
+		return FlushViewOfFile(addr_, 0) != 0;
+#else
+		return msync(addr_, size_, MS_SYNC) == 0;
+#endif
+	}
+
+	MappedWriter::MappedWriter(const String &path, size_t growStep)
 	{
-#ifdef _WIN32
-		char *buffer = NULL;
-		DWORD siz = MAX_PATH;
-		buffer = (char*)malloc(siz);
-		DWORD retval = GetFullPathNameA(relativePath.c_str(), siz, buffer, 0);
-		if (retval == 0)
+		path_ = path;
+		addr_ = NULL;
+		size_ = capacity_ = 0;
+		reserved_ = 0;
+		// whole allocation granules, 64KB on Windows
+		growStep_ = (max<size_t>(growStep, 1 << 16) + 0xffff) & ~static_cast<size_t>(0xffff);
+
+#if ZULIB_OS == 0
+		fd_ = _open(path.c_str(), _O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+		fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+#endif
+		if (fd_ < 0)
+			throw IOException(TO_STRING("Failed to open file: " << path_));
+
+		try
 		{
-			throw IOException(TO_STRING("Failed to get realpath with code: " << GetLastError()));
-			return relativePath;
+			grow(growStep_);
 		}
-		else if (retval > siz)
+		catch (...)
 		{
-			// need larger buffer
-			free(buffer);
-			siz = retval;
-			buffer = (char*)malloc(siz);
-			if (!buffer)
-			{
-				throw RuntimeException("Failed to allocate memory for path buffer!");
-				return relativePath;
-			}
+			close();
+			throw;
+		}
+	}
 
-			retval = GetFullPathNameA(relativePath.c_str(), siz, buffer, 0);
-			if (retval > siz)
-			{
-				// There must be some problem
-				throw RuntimeException("Failed to get realpath, may be too lomg!");
-				return relativePath;
-			}
+	MappedWriter::~MappedWriter()
+	{
+		try
+		{
+			close();
 		}
-		
-		// now good to return
-		String ret(buffer);
-		free(buffer);
-		ret = reform(ret);
-		return ret;
-#else
-#ifdef PATH_MAX
-		char buffer[PATH_MAX+1];
-		char *realPath = realpath(relativePath.c_str(), buffer);
-		if (realPath)
+		catch (...)
 		{
-			String ret(realPath);
-			return ret;
 		}
-		else
+	}
+
+	void MappedWriter::map_view(size_t len)
+	{
+#if ZULIB_OS == 0
+		// the file is extended to the size of the mapping object
+		HANDLE hMap = CreateFileMappingA(reinterpret_cast<HANDLE>(_get_osfhandle(fd_)), NULL, PAGE_READWRITE,
+			static_cast<DWORD>(static_cast<uint64>(len) >> 32), static_cast<DWORD>(len & 0xffffffff), NULL);
+		if (hMap != NULL)
 		{
-			throw IOException("Failed to get realpath!");
-			return relativePath;
+			addr_ = static_cast<char*>(MapViewOfFile(hMap, FILE_MAP_WRITE, 0, 0, len));
+			CloseHandle(hMap);
 		}
 #else
-		// try providing NULL buffer with good luck
-		char *realPath = realpath(relativePath.c_str(), NULL);
-		if (realPath)
+		void *addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+		addr_ = addr == MAP_FAILED ? NULL : static_cast<char*>(addr);
+#endif
+		if (addr_ == NULL)
+			throw IOException(TO_STRING("Failed to map file: " << path_));
+	}
+
+	void MappedWriter::grow(uint64 need)
+	{
+		uint64 cap = (need + growStep_ - 1) / growStep_ * growStep_;
+		cap = max(cap, capacity_ + growStep_);
+		if (cap > static_cast<uint64>(std::numeric_limits<size_t>::max()))
+			throw IOException(TO_STRING("File too large to map: " << path_));
+
+#if ZULIB_OS == 0
+		if (addr_ != NULL)
+			UnmapViewOfFile(addr_);
+		addr_ = NULL;
+		map_view(static_cast<size_t>(cap));
+#else
+		// allocate blocks now, writing to a hole of a full disk through a mapping raises SIGBUS
+		int ret = -1;
+#if defined(__linux__)
+		ret = fallocate(fd_, 0, static_cast<off_t>(capacity_), static_cast<off_t>(cap - capacity_));
+		if (ret != 0 && errno != EOPNOTSUPP && errno != ENOSYS)
+			throw IOException(TO_STRING("Failed to allocate space for file: " << path_));
+#endif
+		if (ret != 0 && ftruncate(fd_, static_cast<off_t>(cap)) != 0)
+			throw IOException(TO_STRING("Failed to resize file: " << path_));
+
+		if (addr_ == NULL)
 		{
-			String ret(realPath);
-			free(realPath);
-			return reform(ret);
+			map_view(static_cast<size_t>(cap));
 		}
 		else
 		{
-			throw IOException("Failed to get realpath!");
-			return relativePath;
+#if defined(__linux__)
+			// pages already mapped are moved, not faulted in again
+			void *addr = mremap(addr_, static_cast<size_t>(capacity_), static_cast<size_t>(cap), MREMAP_MAYMOVE);
+			if (addr == MAP_FAILED)
+				throw IOException(TO_STRING("Failed to map file: " << path_));
+			addr_ = static_cast<char*>(addr);
+#else
+			munmap(addr_, static_cast<size_t>(capacity_));
+			addr_ = NULL;
+			map_view(static_cast<size_t>(cap));
+#endif
 		}
 #endif
+		capacity_ = cap;
+	}
+
+	char* MappedWriter::reserve(size_t len)
+	{
+		if (addr_ == NULL)
+			throw IOException(TO_STRING("Writer is closed: " << path_));
+		if (size_ + len > capacity_)
+			grow(size_ + len);
+		reserved_ = len;
+		return addr_ + size_;
+	}
+
+	void MappedWriter::commit(size_t len)
+	{
+		if (len > reserved_)
+			throw ArgException(TO_STRING("Commit " << len << " bytes exceeds reserved " << reserved_));
+		size_ += len;
+		reserved_ = 0;
+	}
+
+	void MappedWriter::write(const void *data, size_t len)
+	{
+		memcpy(reserve(len), data, len);
+		commit(len);
+	}
+
+	void MappedWriter::sync()
+	{
+		if (addr_ == NULL)
+			return;
+
+#if ZULIB_OS == 0
+		const bool ok = FlushViewOfFile(addr_, static_cast<size_t>(size_)) != 0
+			&& FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(fd_))) != 0;
+#else
+		const bool ok = msync(addr_, static_cast<size_t>(size_), MS_SYNC) == 0;
+#endif
+		if (!ok)
+			throw IOException(TO_STRING("Failed to sync file: " << path_));
+	}
+
+	void MappedWriter::close()
+	{
+		if (fd_ < 0)
+			return;
 
+#if ZULIB_OS == 0
+		if (addr_ != NULL)
+			UnmapViewOfFile(addr_);
+		addr_ = NULL;
+		const bool ok = _chsize_s(fd_, static_cast<__int64>(size_)) == 0;
+		_close(fd_);
+#else
+		if (addr_ != NULL)
+			munmap(addr_, static_cast<size_t>(capacity_));
+		addr_ = NULL;
+		// drop the preallocated tail
+		const bool ok = ftruncate(fd_, static_cast<off_t>(size_)) == 0;
+		::close(fd_);
 #endif
+		fd_ = -1;
+		reserved_ = 0;
+		if (!ok)
+			throw IOException(TO_STRING("Failed to resize file: " << path_));
 	}
 
+	Decompressor::Decompressor()
+	{
+		source_ = NULL;
+		stream_ = NULL;
+		codec_ = NONE;
+		end_ = true;
+		memberEnd_ = false;
+	}
 
-	int Path::is_exist(String path)
+	int Decompressor::detect(const char *magic, size_t len)
 	{
-#ifdef _WIN32
-		DWORD ret = GetFileAttributesA(path.c_str());
-		if (ret == INVALID_FILE_ATTRIBUTES)
-		{
-			const DWORD err = GetLastError();
-			if (err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND)
-			{
-				return 0;
-			}
-			else
-			{
-				return -1;
-			}
-		}
+		const uchar *m = reinterpret_cast<const uchar*>(magic);
+		if (len >= 3 && m[0] == 0x1f && m[1] == 0x8b && m[2] == 0x08)
+			return GZIP;
+		// only the usual compression levels, "x^" is too common in plain text
+		if (len >= 2 && m[0] == 0x78 && (m[1] == 0x01 || m[1] == 0x9c || m[1] == 0xda))
+			return ZLIB;
+		if (len >= 10 && memcmp(m, "BZh", 3) == 0 && m[3] >= '1' && m[3] <= '9'
+			&& (memcmp(m + 4, "\x31\x41\x59\x26\x53\x59", 6) == 0 || memcmp(m + 4, "\x17\x72\x45\x38\x50\x90", 6) == 0))
+			return BZIP2;
+		if (len >= 6 && memcmp(m, "\xfd" "7zXZ\0", 6) == 0)
+			return XZ;
+		if (len >= 4 && memcmp(m, "\x28\xb5\x2f\xfd", 4) == 0)
+			return ZSTD;
+		return NONE;
+	}
 
-		return 1;
+	int Decompressor::detect(const String &path)
+	{
+#if ZULIB_OS == 0
+		struct __stat64 sb;
+		if (_stat64(path.c_str(), &sb) != 0 || !(sb.st_mode & _S_IFREG))
+			return NONE;
 #else
 		struct stat sb;
-		if (stat(path.c_str(), &sb) == 0)
-		{
-			return 1;
-		}
-		else
-		{
-			return -1;
-		}
+		if (stat(path.c_str(), &sb) != 0 || !S_ISREG(sb.st_mode))
+			return NONE;
 #endif
+		std::ifstream fin(path.c_str(), std::ios::in | std::ios::binary);
+		char magic[10];
+		fin.read(magic, sizeof(magic));
+		return detect(magic, static_cast<size_t>(fin.gcount()));
 	}
 
+	bool Decompressor::is_supported(int codec)
+	{
+#ifdef ZULIB_HAVE_ZLIB
+		return codec == GZIP || codec == ZLIB;
+#else
+		return false;
+#endif
+	}
 
-	int Path::is_directory(String path)
+	void Decompressor::open(std::istream *source, int codec, size_t blockSize)
 	{
-#ifdef _WIN32
-		if (is_exist(path) < 1)
+		close();
+		if (!is_supported(codec))
+			throw IOException(TO_STRING("Compression codec " << codec << " is not supported by this build."));
+
+#ifdef ZULIB_HAVE_ZLIB
+		z_stream *zs = new z_stream;
+		memset(zs, 0, sizeof(z_stream));
+		// 15 + 32: maximum window, gzip or zlib header detected automatically
+		if (inflateInit2(zs, 15 + 32) != Z_OK)
 		{
-			return -1;
+			delete zs;
+			throw RuntimeException("Failed to initialize zlib.");
 		}
+		stream_ = zs;
+#endif
+		source_ = source;
+		codec_ = codec;
+		end_ = memberEnd_ = false;
+		in_.resize(max<size_t>(blockSize, 4096));
+	}
 
-		DWORD ret = GetFileAttributesA(path.c_str());
-		if (ret & FILE_ATTRIBUTE_DIRECTORY)
+	void Decompressor::close()
+	{
+#ifdef ZULIB_HAVE_ZLIB
+		if (stream_ != NULL)
 		{
-			return 1;
+			z_stream *zs = static_cast<z_stream*>(stream_);
+			inflateEnd(zs);
+			delete zs;
 		}
-		else
-		{
+#endif
+		stream_ = NULL;
+		source_ = NULL;
+		end_ = true;
+	}
+
+	size_t Decompressor::read(char *dst, size_t len)
+	{
+		if (stream_ == NULL || end_ || len == 0)
 			return 0;
-		}
-#else
-		struct stat sb;
-		if (stat(path.c_str(), &sb) == 0)
+
+		size_t nout = 0;
+#ifdef ZULIB_HAVE_ZLIB
+		z_stream *zs = static_cast<z_stream*>(stream_);
+		while (nout < len)
 		{
-			if (S_ISDIR(sb.st_mode))
+			if (zs->avail_in == 0)
 			{
-				return 1;
+				source_->read(&in_.front(), static_cast<std::streamsize>(in_.size()));
+				const size_t nin = static_cast<size_t>(source_->gcount());
+				if (nin == 0)
+				{
+					if (!memberEnd_)
+						throw IOException("Unexpected end of compressed stream.");
+					end_ = true;
+					break;
+				}
+				zs->next_in = reinterpret_cast<Bytef*>(&in_.front());
+				zs->avail_in = static_cast<uInt>(nin);
 			}
 
-			if (S_ISREG(sb.st_mode))
+			if (memberEnd_)
 			{
-				return 0;
+				// concatenated gzip members, anything else after the end is ignored like gzip does
+				if (zs->next_in[0] != 0x1f)
+				{
+					end_ = true;
+					break;
+				}
+				inflateReset(zs);
+				memberEnd_ = false;
 			}
-		}
 
-		return -1;
+			const size_t want = min<size_t>(len - nout, UINT_MAX);
+			zs->next_out = reinterpret_cast<Bytef*>(dst + nout);
+			zs->avail_out = static_cast<uInt>(want);
+			const int ret = inflate(zs, Z_NO_FLUSH);
+			nout += want - zs->avail_out;
+			if (ret == Z_STREAM_END)
+			{
+				if (codec_ != GZIP)
+				{
+					end_ = true;
+					break;
+				}
+				memberEnd_ = true;
+			}
+			else if (ret != Z_OK && ret != Z_BUF_ERROR)
+			{
+				throw IOException(TO_STRING("Corrupted compressed stream: " << (zs->msg != NULL ? zs->msg : "unknown error")));
+			}
+		}
 #endif
+		return nout;
 	}
 
-
-
-	String Path::reform(String orig)
+	uint64 Decompressor::skip(uint64 n)
 	{
-		std::replace(orig.begin(), orig.end(), '\\', '/');
+		if (n == 0)
+			return 0;
 
-		size_t pos;
-		while ((pos = orig.find("//")) != String::npos)
+		std::vector<char> buf(static_cast<size_t>(min<uint64>(n, 256 * 1024)));
+		uint64 skipped = 0;
+		while (skipped < n)
 		{
-			orig.erase(orig.begin() + pos);
+			const size_t got = read(&buf.front(), static_cast<size_t>(min<uint64>(buf.size(), n - skipped)));
+			if (got == 0)
+				break;
+			skipped += got;
 		}
+		return skipped;
+	}
 
-		return orig;
+	ReadAhead::ReadAhead()
+	{
+		head_ = tail_ = count_ = consumed_ = 0;
+		offset_ = 0;
+		codec_ = Decompressor::NONE;
+		done_ = failed_ = stop_ = false;
+		fd_ = -1;
 	}
 
-	String Path::get_dir()
+	bool ReadAhead::start(const String &path, uint64 offset, size_t blockSize, int depth, int codec)
 	{
-		String ret = this->path_;
-		const size_t last_slash_idx = ret.find_last_of("\\/");
-		if (std::string::npos != last_slash_idx)
+		stop();
+
+#if ZULIB_OS == 1
+		fd_ = ::open(path.c_str(), O_RDONLY);
+		struct stat sb;
+		if (fd_ < 0 || fstat(fd_, &sb) != 0 || !S_ISREG(sb.st_mode))
 		{
-			ret.erase(last_slash_idx);
+			if (fd_ >= 0)
+				::close(fd_);
+			fd_ = -1;
+			return false;
 		}
-		// in case a double slash
-		while (*ret.rbegin() == '\\' || *ret.rbegin() == '/')
+#if defined(POSIX_FADV_SEQUENTIAL)
+		posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#else
+		if (Path::is_directory(path) != 0)
+			return false;
+#endif
+
+		path_ = path;
+		depth = max(depth, 2);
+		ring_.resize(depth);
+		for (int i = 0; i < depth; i++)
 		{
-			ret.erase(ret.length() - 1);
+			ring_[i].resize(max<size_t>(blockSize, 4096));
 		}
-
-		return ret;
+		lens_.assign(depth, 0);
+		head_ = tail_ = count_ = consumed_ = 0;
+		offset_ = offset;
+		codec_ = codec;
+		done_ = failed_ = stop_ = false;
+		thread_.start(worker, this);
+		return true;
 	}
 
-
-	String Path::get_basename()
+	void ReadAhead::stop()
 	{
-		String ret = this->path_;
-		const size_t last_slash_idx = ret.find_last_of("\\/");
-		if (std::string::npos != last_slash_idx)
+		if (thread_.joinable())
+		{
+			{
+				ScopedLock lock(mutex_);
+				stop_ = true;
+				freed_.notify_all();
+			}
+			thread_.join();
+		}
+
+#if ZULIB_OS == 1
+		if (fd_ >= 0)
+			::close(fd_);
+#endif
+		fd_ = -1;
+		head_ = tail_ = count_ = consumed_ = 0;
+		done_ = true;
+	}
+
+	void ReadAhead::worker(void *self)
+	{
+		ReadAhead &ra = *static_cast<ReadAhead*>(self);
+
+		// compressed blocks are decoded here, overlapping with line splitting in the consumer
+		std::ifstream fin;
+		Decompressor decoder;
+		bool failed = false;
+		if (ra.codec_ != Decompressor::NONE)
+		{
+			fin.open(ra.path_.c_str(), std::ios::in | std::ios::binary);
+			try
+			{
+				decoder.open(&fin, ra.codec_);
+				decoder.skip(ra.offset_);
+			}
+			catch (...)
+			{
+				failed = true;
+			}
+		}
+#if ZULIB_OS != 1
+		std::ifstream fread(ra.path_.c_str(), std::ios::in | std::ios::binary);
+		fread.seekg(static_cast<std::streamoff>(ra.offset_));
+#endif
+		if (failed)
+		{
+			ScopedLock lock(ra.mutex_);
+			ra.done_ = ra.failed_ = true;
+			ra.filled_.notify_one();
+			return;
+		}
+
+		for (;;)
+		{
+			size_t idx;
+			uint64 offset;
+			{
+				ScopedLock lock(ra.mutex_);
+				while (ra.count_ == ra.ring_.size() && !ra.stop_)
+				{
+					ra.freed_.wait(ra.mutex_);
+				}
+				if (ra.stop_)
+					return;
+				idx = ra.tail_;
+				offset = ra.offset_;
+			}
+
+			// the tail block is invisible to the consumer until count_ grows
+			std::vector<char> &block = ra.ring_[idx];
+			size_t len = 0;
+			if (ra.codec_ != Decompressor::NONE)
+			{
+				try
+				{
+					len = decoder.read(&block.front(), block.size());
+				}
+				catch (...)
+				{
+					failed = true;
+				}
+			}
+#if ZULIB_OS == 1
+			else
+			{
+				while (len < block.size())
+				{
+					ssize_t nbuf = pread(ra.fd_, &block.front() + len, block.size() - len, static_cast<off_t>(offset + len));
+					if (nbuf < 0 && errno == EINTR)
+						continue;
+					if (nbuf < 0)
+						failed = true;
+					if (nbuf <= 0)
+						break;
+					len += static_cast<size_t>(nbuf);
+				}
+			}
+#else
+			else
+			{
+				fread.read(&block.front(), static_cast<std::streamsize>(block.size()));
+				len = static_cast<size_t>(fread.gcount());
+				failed = fread.bad();
+			}
+#endif
+
+			ScopedLock lock(ra.mutex_);
+			if (len > 0)
+			{
+				ra.lens_[idx] = len;
+				ra.tail_ = (ra.tail_ + 1) % ra.ring_.size();
+				ra.count_++;
+				ra.offset_ += len;
+			}
+			if (len < block.size())
+			{
+				ra.done_ = true;
+				ra.failed_ = failed;
+			}
+			ra.filled_.notify_one();
+			if (ra.done_)
+				return;
+		}
+	}
+
+	const char* ReadAhead::acquire(size_t &len)
+	{
+		ScopedLock lock(mutex_);
+		while (count_ == 0 && !done_)
+		{
+			filled_.wait(mutex_);
+		}
+
+		if (count_ == 0)
+		{
+			if (failed_)
+				throw IOException(TO_STRING("Failed to read ahead file: " << path_));
+			len = 0;
+			return NULL;
+		}
+
+		len = lens_[head_] - consumed_;
+		return &ring_[head_].front() + consumed_;
+	}
+
+	void ReadAhead::release(size_t len)
+	{
+		ScopedLock lock(mutex_);
+		consumed_ += len;
+		if (count_ > 0 && consumed_ >= lens_[head_])
+		{
+			head_ = (head_ + 1) % ring_.size();
+			count_--;
+			consumed_ = 0;
+			freed_.notify_one();
+		}
+	}
+
+	size_t ReadAhead::read(char *dst, size_t len)
+	{
+		size_t copied = 0;
+		while (copied < len)
+		{
+			size_t avail;
+			const char *src = acquire(avail);
+			if (src == NULL)
+				break;
+			const size_t n = min(avail, len - copied);
+			memcpy(dst + copied, src, n);
+			release(n);
+			copied += n;
+		}
+		return copied;
+	}
+
+	TextFile::TextFile()
+	{
+		rdata_ = NULL;
+		rbegin_ = rend_ = 0;
+		roffset_ = 0;
+		rEof_ = eof_ = false;
+		lineNo_ = 1;
+		indexInterval_ = 0;
+		prefetchDepth_ = 0;
+		prefetchBlock_ = 0;
+		notifyFd_ = fileWatch_ = -1;
+		fileId_ = 0;
+	}
+
+	TextFile::TextFile(String file, std::ios_base::openmode openmode, int mapped) : BaseFile(file, openmode)
+	{
+		rdata_ = NULL;
+		rbegin_ = rend_ = 0;
+		roffset_ = 0;
+		rEof_ = eof_ = false;
+		lineNo_ = 1;
+		indexInterval_ = 0;
+		prefetchDepth_ = 0;
+		prefetchBlock_ = 0;
+		notifyFd_ = fileWatch_ = -1;
+		fileId_ = 0;
+
+		enable_decompression();
+
+		// writable files keep changing underneath, always use stream for them
+		if (mapped > 0 && !(openmode & std::ios_base::out) && codec_ == Decompressor::NONE)
+		{
+			map_.map(path_, 0, FileMap::SEQUENTIAL);
+		}
+
+		reset_reader(0);
+	}
+
+	TextFile::~TextFile()
+	{
+#ifdef ZULIB_INOTIFY
+		if (notifyFd_ >= 0)
+			::close(notifyFd_);
+#endif
+	}
+
+	int TextFile::count_lines()
+	{
+		if (map_.is_mapped())
+		{
+			int ct = static_cast<int>(count_newlines(map_.data(), map_.size()));
+
+			if (map_.size() == 0 || map_.data()[map_.size() - 1] != '\n')
+				ct++;
+
+			return ct;
+		}
+
+		if (prefetchDepth_ > 0)
+		{
+			// count blocks in place while the next ones are being read
+			ReadAhead ra;
+			if (ra.start(path_, 0, prefetchBlock_, prefetchDepth_, codec_))
+			{
+				int ct = 0;
+				char last = 0;
+				size_t len;
+				const char *p;
+				while ((p = ra.acquire(len)) != NULL)
+				{
+					ct += static_cast<int>(count_newlines(p, len));
+					last = p[len - 1];
+					ra.release(len);
+				}
+
+				if (last != '\n')
+					ct++;
+
+				return ct;
+			}
+		}
+
+		std::ifstream fread(path_.c_str(), codec_ == Decompressor::NONE ? std::ios::in : std::ios::in | std::ios::binary);
+		if (!fread.is_open())
+		{
+			throw IOException("Failed to open file to count lines.");
+			return -1;
+		}
+
+		Decompressor decoder;
+		if (codec_ != Decompressor::NONE)
+			decoder.open(&fread, codec_);
+
+		const int bufSize = 1024 * 1024;	// using 1MB buffer
+		std::vector<char> buf(bufSize);
+
+		int ct = 0;
+		int nbuf = 0;
+		char last = 0;
+		do
+		{
+			if (decoder.is_open())
+			{
+				nbuf = static_cast<int>(decoder.read(&buf.front(), bufSize));
+			}
+			else
+			{
+				fread.read(&buf.front(), bufSize);
+				nbuf = static_cast<int>(fread.gcount());
+			}
+			if (nbuf > 0)
+			{
+				ct += static_cast<int>(count_newlines(&buf.front(), nbuf));
+				last = buf[nbuf - 1];
+			}
+		} while (nbuf > 0);
+
+		if (last != '\n')
+			ct++;
+
+		return ct;
+	}
+
+
+	namespace
+	{
+		// one byte range [begin, end) of a file counted by a worker thread
+		struct CountLinesTask
+		{
+			const char	*data;	// mapped file, or NULL to read from path/fd
+			String		path;
+			int			fd;
+			uint64		begin;
+			uint64		end;
+			uint64		count;
+			bool		failed;
+		};
+
+		void count_lines_task(void *arg)
+		{
+			CountLinesTask &task = *static_cast<CountLinesTask*>(arg);
+			task.count = 0;
+			task.failed = false;
+
+			if (task.data != NULL)
+			{
+				task.count = count_newlines(task.data + task.begin, static_cast<size_t>(task.end - task.begin));
+				return;
+			}
+
+			const size_t bufSize = 1024 * 1024;	// using 1MB buffer
+			std::vector<char> buf(bufSize);
+#if ZULIB_OS == 1
+			for (uint64 pos = task.begin; pos < task.end;)
+			{
+				size_t want = static_cast<size_t>(min<uint64>(bufSize, task.end - pos));
+				ssize_t nbuf = pread(task.fd, &buf.front(), want, static_cast<off_t>(pos));
+				if (nbuf < 0 && errno == EINTR)
+					continue;
+				if (nbuf <= 0)
+				{
+					task.failed = true;
+					return;
+				}
+				task.count += count_newlines(&buf.front(), static_cast<size_t>(nbuf));
+				pos += static_cast<uint64>(nbuf);
+			}
+#else
+			std::ifstream fread(task.path.c_str(), std::ios::in | std::ios::binary);
+			fread.seekg(static_cast<std::streamoff>(task.begin));
+			for (uint64 pos = task.begin; pos < task.end;)
+			{
+				std::streamsize want = static_cast<std::streamsize>(min<uint64>(bufSize, task.end - pos));
+				fread.read(&buf.front(), want);
+				std::streamsize nbuf = fread.gcount();
+				if (nbuf <= 0)
+				{
+					task.failed = true;
+					return;
+				}
+				task.count += count_newlines(&buf.front(), static_cast<size_t>(nbuf));
+				pos += static_cast<uint64>(nbuf);
+			}
+#endif
+		}
+	}
+
+	int TextFile::count_lines(int threads)
+	{
+		if (threads <= 0)
+			threads = Thread::hardware_concurrency();
+
+		// compressed data can only be decoded from the beginning
+		if (codec_ != Decompressor::NONE)
+			return count_lines();
+
+		// get the size, only regular files can be split
+		uint64 size = 0;
+		const char *data = NULL;
+		char last = 0;
+		int fd = -1;
+		if (map_.is_mapped())
+		{
+			size = map_.size();
+			data = map_.data();
+			if (size > 0)
+				last = data[size - 1];
+		}
+		else
+		{
+#if ZULIB_OS == 1
+			fd = ::open(path_.c_str(), O_RDONLY);
+			struct stat sb;
+			if (fd < 0 || fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode))
+			{
+				if (fd >= 0)
+					::close(fd);
+				return count_lines();
+			}
+			size = static_cast<uint64>(sb.st_size);
+			if (size > 0 && pread(fd, &last, 1, static_cast<off_t>(size - 1)) != 1)
+			{
+				::close(fd);
+				throw IOException("Failed to read file to count lines.");
+			}
+#else
+			std::ifstream fread(path_.c_str(), std::ios::in | std::ios::binary);
+			if (!fread.is_open() || Path::is_directory(path_) != 0)
+				return count_lines();
+			fread.seekg(0, std::ios::end);
+			size = static_cast<uint64>(fread.tellg());
+			if (size > 0)
+			{
+				fread.seekg(-1, std::ios::end);
+				fread.get(last);
+			}
+#endif
+		}
+
+		// not worth a thread for less than 1MB
+		const uint64 minChunk = 1024 * 1024;
+		threads = static_cast<int>(min<uint64>(static_cast<uint64>(threads), size / minChunk));
+		if (threads <= 1)
+		{
+#if ZULIB_OS == 1
+			if (fd >= 0)
+				::close(fd);
+#endif
+			return count_lines();
+		}
+
+		// split into page aligned ranges
+		const uint64 chunk = (size / threads + 4095) & ~static_cast<uint64>(4095);
+		std::vector<CountLinesTask> tasks(threads);
+		Thread *workers = new Thread[threads];
+		for (int i = 0; i < threads; i++)
+		{
+			tasks[i].data = data;
+			tasks[i].path = path_;
+			tasks[i].fd = fd;
+			tasks[i].begin = min(chunk * i, size);
+			tasks[i].end = (i == threads - 1) ? size : min(chunk * (i + 1), size);
+			try
+			{
+				workers[i].start(count_lines_task, &tasks[i]);
+			}
+			catch (...)
+			{
+				// joins the started workers before tasks goes away
+				delete[] workers;
+#if ZULIB_OS == 1
+				if (fd >= 0)
+					::close(fd);
+#endif
+				throw;
+			}
+		}
+
+		uint64 ct = 0;
+		bool failed = false;
+		for (int i = 0; i < threads; i++)
+		{
+			workers[i].join();
+			ct += tasks[i].count;
+			failed = failed || tasks[i].failed;
+		}
+		delete[] workers;
+#if ZULIB_OS == 1
+		if (fd >= 0)
+			::close(fd);
+#endif
+
+		if (failed)
+			throw IOException("Failed to read file to count lines.");
+
+		if (last != '\n')
+			ct++;
+
+		return static_cast<int>(ct);
+	}
+
+
+	void TextFile::reset_reader(uint64 offset)
+	{
+		eof_ = false;
+		if (map_.is_mapped())
+		{
+			// the whole mapping is one buffer which never refills
+			rdata_ = map_.data();
+			rbegin_ = static_cast<size_t>(min<uint64>(offset, map_.size()));
+			rend_ = map_.size();
+			roffset_ = 0;
+			rEof_ = true;
+			return;
+		}
+
+		rdata_ = rbuf_.empty() ? NULL : &rbuf_.front();
+		rbegin_ = rend_ = 0;
+		roffset_ = offset;
+		rEof_ = false;
+
+		if (prefetchDepth_ > 0 && readAhead_.start(path_, offset, prefetchBlock_, prefetchDepth_, codec_))
+			return;
+
+		// the stream is only used without read-ahead, avoid decoding twice
+		prefetchDepth_ = 0;
+		seek_stream(offset);
+	}
+
+	int TextFile::prefetch(int enable, int depth, size_t blockSize)
+	{
+		const uint64 pos = roffset_ + rbegin_;
+		if (enable > 0 && !map_.is_mapped() && !(openmode_ & std::ios_base::out))
+		{
+			prefetchDepth_ = max(depth, 2);
+			prefetchBlock_ = blockSize;
+		}
+		else
+		{
+			prefetchDepth_ = 0;
+			readAhead_.stop();
+		}
+
+		// continue at the same position with the new source, line number unchanged
+		if (!map_.is_mapped())
+			reset_reader(pos);
+
+		return prefetchDepth_ > 0 ? 1 : 0;
+	}
+
+	bool TextFile::fill_buffer()
+	{
+		if (rEof_)
+			return false;
+
+		// keep the unfinished line, move it to the front
+		if (rbegin_ > 0)
+		{
+			memmove(&rbuf_.front(), &rbuf_.front() + rbegin_, rend_ - rbegin_);
+			roffset_ += rbegin_;
+			rend_ -= rbegin_;
+			rbegin_ = 0;
+		}
+
+		// grow only if a single line is longer than the buffer
+		if (rend_ == rbuf_.size())
+		{
+			rbuf_.resize(max<size_t>(rbuf_.size() * 2, 1024 * 1024));	// at least 1MB
+		}
+		rdata_ = &rbuf_.front();
+
+		size_t nbuf = 0;
+		if (prefetchDepth_ > 0)
+		{
+			nbuf = readAhead_.read(&rbuf_.front() + rend_, rbuf_.size() - rend_);
+		}
+		else
+		{
+			nbuf = read_stream(&rbuf_.front() + rend_, rbuf_.size() - rend_);
+		}
+		if (nbuf == 0)
+		{
+			rEof_ = true;
+			return false;
+		}
+		add_checksum(roffset_ + rend_, &rbuf_.front() + rend_, nbuf);
+		rend_ += nbuf;
+		return true;
+	}
+
+	void TextFile::hash_pending()
+	{
+		if (map_.is_mapped())
+			add_checksum(0, map_.data(), rbegin_);
+	}
+
+	uint64 TextFile::skip_lines(uint64 n)
+	{
+		uint64 skipped = 0;
+		while (skipped < n)
+		{
+			const char *begin = rdata_ + rbegin_;
+			const size_t avail = rend_ - rbegin_;
+			const size_t ct = count_newlines(begin, avail);
+			if (ct >= n - skipped)
+			{
+				const char *p = skip_newlines(begin, avail, static_cast<size_t>(n - skipped));
+				rbegin_ += p - begin;
+				skipped = n;
+				break;
+			}
+
+			skipped += ct;
+			rbegin_ = rend_;
+			if (!fill_buffer())
+				break;
+		}
+		lineNo_ += skipped;
+		return skipped;
+	}
+
+	int TextFile::next_line(LineRef &line)
+	{
+		return read_line(line, true);
+	}
+
+	int TextFile::read_line(LineRef &line, bool partial)
+	{
+		if (!map_.is_mapped() && !fp_.is_open())
+			return -1;
+
+		size_t scanned = 0;	// bytes after rbegin_ known to have no newline
+		for (;;)
+		{
+			const size_t from = rbegin_ + scanned;
+			const char *nl = (from < rend_) ? static_cast<const char*>(memchr(rdata_ + from, '\n', rend_ - from)) : NULL;
+			if (nl != NULL)
+			{
+				line.data = rdata_ + rbegin_;
+				line.size = nl - line.data;
+				line.offset = roffset_ + rbegin_;
+				line.lineNo = lineNo_++;
+				rbegin_ = nl - rdata_ + 1;
+				return 1;
+			}
+
+			scanned = rend_ - rbegin_;
+			if (!fill_buffer())
+				break;
+		}
+
+		if (partial && rbegin_ < rend_)
+		{
+			// last line without newline
+			line.data = rdata_ + rbegin_;
+			line.size = rend_ - rbegin_;
+			line.offset = roffset_ + rbegin_;
+			line.lineNo = lineNo_++;
+			rbegin_ = rend_;
+			eof_ = true;
+			return 1;
+		}
+
+		line.data = NULL;
+		line.size = 0;
+		line.offset = roffset_ + rbegin_;
+		line.lineNo = lineNo_;
+		return 0;
+	}
+
+	namespace
+	{
+		// identify a file by volume and inode or file index, changes when a log is rotated
+		bool file_identity(const String &path, uint64 &id, uint64 &size)
+		{
+#if ZULIB_OS == 0
+			// no access rights needed to query, sharing everything keeps the writer undisturbed
+			HANDLE hFile = CreateFileA(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+				NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (hFile == INVALID_HANDLE_VALUE)
+				return false;
+			BY_HANDLE_FILE_INFORMATION info;
+			const BOOL ok = GetFileInformationByHandle(hFile, &info);
+			CloseHandle(hFile);
+			if (!ok)
+				return false;
+			id = (static_cast<uint64>(info.dwVolumeSerialNumber) << 32)
+				^ ((static_cast<uint64>(info.nFileIndexHigh) << 32) | info.nFileIndexLow);
+			size = (static_cast<uint64>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+			return true;
+#else
+			struct stat sb;
+			if (stat(path.c_str(), &sb) != 0)
+				return false;
+			id = (static_cast<uint64>(sb.st_dev) << 32) ^ static_cast<uint64>(sb.st_ino);
+			size = static_cast<uint64>(sb.st_size);
+			return true;
+#endif
+		}
+	}
+
+	int TextFile::follow_line(LineRef &line, int timeoutMs)
+	{
+		if (!map_.is_mapped() && !fp_.is_open())
+			return -1;
+
+		if (codec_ != Decompressor::NONE)
+			return read_line(line, true);
+
+		if (map_.is_mapped())
+		{
+			// a mapping can not grow, continue with stream from the same position
+			const uint64 pos = roffset_ + rbegin_;
+			map_.unmap();
+			reset_reader(pos);
+		}
+
+		if (prefetchDepth_ > 0)
+		{
+			// read-ahead stops at end of file for good
+			prefetch(0);
+		}
+
+		if (fileId_ == 0)
+		{
+			uint64 size;
+			file_identity(path_, fileId_, size);
+		}
+
+		const double deadline = Timer::get_real_time() + timeoutMs / 1000.0;
+		for (;;)
+		{
+			// data may have been appended since last end of file
+			if (rEof_)
+			{
+				rEof_ = false;
+				fp_.clear();
+			}
+
+			if (read_line(line, false) > 0)
+				return 1;
+
+			const int changed = check_follow(line);
+			if (changed > 0)
+				return 1;
+			if (changed < 0)
+				continue;
+
+			int remain = -1;
+			if (timeoutMs >= 0)
+			{
+				remain = static_cast<int>((deadline - Timer::get_real_time()) * 1000.0);
+				if (remain <= 0)
+					return 0;
+			}
+
+			wait_follow(remain);
+		}
+	}
+
+	int TextFile::check_follow(LineRef &line)
+	{
+		uint64 id, size;
+		if (!file_identity(path_, id, size))
+		{
+			// renamed or deleted, keep reading the old one until a new file shows up
+			return 0;
+		}
+
+		if (id != fileId_)
+		{
+			// rotated, flush the unterminated tail of the old file first
+			if (read_line(line, true) > 0)
+				return 1;
+
+			fp_.close();
+			fp_.clear();
+			open();
+			fileId_ = id;
+#ifdef ZULIB_INOTIFY
+			if (fileWatch_ >= 0)
+			{
+				inotify_rm_watch(notifyFd_, fileWatch_);
+				fileWatch_ = inotify_add_watch(notifyFd_, path_.c_str(), IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+			}
+#endif
+			reset_reader(0);
+			lineNo_ = 1;
+			return -1;
+		}
+
+		if (size < roffset_ + rend_)
+		{
+			// truncated, start over
+			reset_reader(0);
+			lineNo_ = 1;
+			return -1;
+		}
+		return 0;
+	}
+
+	bool TextFile::wait_follow(int timeoutMs)
+	{
+#ifdef ZULIB_INOTIFY
+		if (notifyFd_ < 0)
+		{
+			notifyFd_ = inotify_init();
+			if (notifyFd_ < 0)
+				throw IOException("Failed to initialize inotify to follow file.");
+			fcntl(notifyFd_, F_SETFL, O_NONBLOCK);
+			fcntl(notifyFd_, F_SETFD, FD_CLOEXEC);
+
+			fileWatch_ = inotify_add_watch(notifyFd_, path_.c_str(), IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+
+			// a rotated file shows up in the directory
+			const size_t slash = path_.find_last_of('/');
+			const String dir = (slash == String::npos) ? String(".") : (slash == 0 ? String("/") : path_.substr(0, slash));
+			inotify_add_watch(notifyFd_, dir.c_str(), IN_CREATE | IN_MOVED_TO);
+			// the file may have changed before watches were set
+			return true;
+		}
+
+		struct pollfd pfd;
+		pfd.fd = notifyFd_;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int ret;
+		do
+		{
+			ret = poll(&pfd, 1, timeoutMs);
+		} while (ret < 0 && errno == EINTR);
+
+		if (ret <= 0)
+			return false;
+
+		// every event just triggers a new check, drain them
+		char buf[4096];
+		while (::read(notifyFd_, buf, sizeof(buf)) > 0)
+		{
+		}
+		return true;
+#else
+		// no change notification, check periodically
+		const int interval = 50;
+		sleep((timeoutMs >= 0 && timeoutMs < interval) ? timeoutMs : interval);
+		return true;
+#endif
+	}
+
+	size_t TextFile::next_lines(size_t maxLines, LineBatch &batch)
+	{
+		batch.clear();
+		LineRef ref;
+		while (batch.size() < maxLines && next_line(ref) > 0)
+		{
+			batch.append(ref);
+		}
+		return batch.size();
+	}
+
+	int TextFile::next_line(String &line)
+	{
+		// same results as std::getline on the stream
+		if (eof_)
+			return -1;
+
+		LineRef ref;
+		const int ret = next_line(ref);
+		if (ret < 0)
+			return -1;
+
+		if (ret == 0)
+		{
+			eof_ = true;
+			line.clear();
+			return 0;
+		}
+
+		line.assign(ref.data, ref.size);
+		return static_cast<int>(line.length());
+	}
+
+
+	int TextFile::goto_line(int n)
+	{
+		if (!map_.is_mapped() && !fp_.is_open())
+			return -1;
+
+		reset_reader(0);
+		lineNo_ = 1;
+
+		if (n < 0)
+		{
+			Warning("n < 0, seek back to the first line");
+			return 0;
+		}
+
+		if (n == 0)
+		{
+			return 0;
+		}
+
+		// start from the nearest indexed line if available
+		int base = 0;
+		if (!lineIndex_.empty())
+		{
+			size_t idx = min(static_cast<size_t>((n - 1) / indexInterval_), lineIndex_.size() - 1);
+			base = static_cast<int>(idx) * indexInterval_;
+			reset_reader(lineIndex_[idx]);
+			lineNo_ = base + 1;
+		}
+
+		const uint64 skipped = skip_lines(n - 1 - base);
+		if (skipped < static_cast<uint64>(n - 1 - base))
+		{
+			const int reached = base + static_cast<int>(skipped) + 1;
+			eof_ = true;
+			Warning("Reached end of file, line: " << reached);
+			return reached;
+		}
+
+		return n;
+	}
+
+	namespace
+	{
+		// size and modification time used to validate a line index sidecar
+		bool file_signature(const String &path, uint64 &size, int64 &mtime)
+		{
+#if ZULIB_OS == 0
+			struct __stat64 sb;
+			if (_stat64(path.c_str(), &sb) != 0)
+				return false;
+#else
+			struct stat sb;
+			if (stat(path.c_str(), &sb) != 0)
+				return false;
+#endif
+			size = static_cast<uint64>(sb.st_size);
+			mtime = static_cast<int64>(sb.st_mtime);
+			return true;
+		}
+
+		const char LINE_INDEX_MAGIC[8] = { 'Z', 'U', 'L', 'I', 'D', 'X', '1', '\0' };
+
+		// collects offset of every interval-th line from consecutive blocks of a file
+		struct LineIndexBuilder
+		{
+			std::vector<uint64> index;
+			uint64	interval;
+			uint64	newlines;
+			uint64	offset;
+			uint64	next;
+			char	last;
+
+			explicit LineIndexBuilder(uint64 k) : index(1, 0), interval(k), newlines(0), offset(0), next(k), last(0) {};
+
+			void feed(const char *data, size_t len)
+			{
+				if (len == 0)
+					return;
+
+				size_t ct = count_newlines(data, len);
+				const char *p = data;
+				while (newlines + ct >= next)
+				{
+					const size_t skip = static_cast<size_t>(next - newlines);
+					const char *q = skip_newlines(p, len - (p - data), skip);
+					ct -= skip;
+					newlines = next;
+					next += interval;
+					p = q;
+					index.push_back(offset + (p - data));
+				}
+				newlines += ct;
+				offset += len;
+				last = data[len - 1];
+			}
+
+			int lines() { return static_cast<int>(newlines) + (last != '\n' ? 1 : 0); };
+		};
+	}
+
+	int TextFile::build_index(int interval, int save)
+	{
+		if (interval < 1)
+			throw ArgException("Line index interval must be positive!");
+
+		LineIndexBuilder builder(interval);
+		if (map_.is_mapped())
+		{
+			builder.feed(map_.data(), map_.size());
+		}
+		else
+		{
+			std::ifstream fread(path_.c_str(), std::ios::in | std::ios::binary);
+			if (!fread.is_open())
+				throw IOException("Failed to open file to build line index.");
+
+			Decompressor decoder;
+			if (codec_ != Decompressor::NONE)
+				decoder.open(&fread, codec_);
+
+			const int bufSize = 1024 * 1024;	// using 1MB buffer
+			std::vector<char> buf(bufSize);
+			size_t nbuf;
+			do
+			{
+				if (decoder.is_open())
+				{
+					nbuf = decoder.read(&buf.front(), bufSize);
+				}
+				else
+				{
+					fread.read(&buf.front(), bufSize);
+					nbuf = static_cast<size_t>(fread.gcount());
+				}
+				builder.feed(&buf.front(), nbuf);
+			} while (nbuf > 0);
+		}
+
+		lineIndex_.swap(builder.index);
+		indexInterval_ = interval;
+
+		uint64 size;
+		int64 mtime;
+		// offsets of compressed files are in decompressed bytes, only kept in memory
+		if (save > 0 && codec_ == Decompressor::NONE && file_signature(path_, size, mtime) && size == builder.offset)
+		{
+			// | magic | file size | mtime | interval | entries | offsets... |
+			std::ofstream fidx((path_ + ".lidx").c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+			uint64 header[4] = { size, static_cast<uint64>(mtime), static_cast<uint64>(interval), lineIndex_.size() };
+			fidx.write(LINE_INDEX_MAGIC, sizeof(LINE_INDEX_MAGIC));
+			fidx.write(reinterpret_cast<const char*>(header), sizeof(header));
+			fidx.write(reinterpret_cast<const char*>(&lineIndex_.front()), lineIndex_.size() * sizeof(uint64));
+			if (!fidx.good())
+			{
+				Warning("Failed to save line index for " << path_);
+			}
+		}
+
+		return builder.lines();
+	}
+
+	int TextFile::load_index()
+	{
+		uint64 size;
+		int64 mtime;
+		if (codec_ != Decompressor::NONE || !file_signature(path_, size, mtime))
+			return 0;
+
+		std::ifstream fidx((path_ + ".lidx").c_str(), std::ios::in | std::ios::binary);
+		if (!fidx.is_open())
+			return 0;
+
+		char magic[sizeof(LINE_INDEX_MAGIC)];
+		uint64 header[4];
+		fidx.read(magic, sizeof(magic));
+		fidx.read(reinterpret_cast<char*>(header), sizeof(header));
+		if (!fidx.good() || memcmp(magic, LINE_INDEX_MAGIC, sizeof(magic)) != 0
+			|| header[0] != size || header[1] != static_cast<uint64>(mtime)
+			|| header[2] < 1 || header[2] > static_cast<uint64>(INT_MAX)
+			|| header[3] < 1 || header[3] > size + 1)
+		{
+			// stale or broken sidecar
+			return 0;
+		}
+
+		std::vector<uint64> index(static_cast<size_t>(header[3]));
+		fidx.read(reinterpret_cast<char*>(&index.front()), index.size() * sizeof(uint64));
+		if (!fidx.good())
+			return 0;
+
+		lineIndex_.swap(index);
+		indexInterval_ = static_cast<int>(header[2]);
+		return 1;
+	}
+
+	namespace
+	{
+#ifndef ZULIB_SSE2
+		// split a line without quotes at every delimiter, bounds get begin/end pairs
+		void split_fields_scalar(const char *data, size_t len, char delim, std::vector<size_t> &bounds)
+		{
+			size_t start = 0;
+			const char *p;
+			while ((p = static_cast<const char*>(memchr(data + start, delim, len - start))) != NULL)
+			{
+				bounds.push_back(start);
+				bounds.push_back(p - data);
+				start = (p - data) + 1;
+			}
+			bounds.push_back(start);
+			bounds.push_back(len);
+		}
+#endif
+
+#ifdef ZULIB_SSE2
+		inline int lowest_bit(unsigned int mask)
+		{
+#if defined(_MSC_VER)
+			unsigned long idx;
+			_BitScanForward(&idx, mask);
+			return static_cast<int>(idx);
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		void split_fields_sse2(const char *data, size_t len, char delim, std::vector<size_t> &bounds)
+		{
+			const __m128i d = _mm_set1_epi8(delim);
+			size_t start = 0;
+			size_t i = 0;
+			for (; i + 16 <= len; i += 16)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, d)));
+				while (mask)
+				{
+					const size_t pos = i + lowest_bit(mask);
+					bounds.push_back(start);
+					bounds.push_back(pos);
+					start = pos + 1;
+					mask &= mask - 1;
+				}
+			}
+			for (; i < len; i++)
+			{
+				if (data[i] == delim)
+				{
+					bounds.push_back(start);
+					bounds.push_back(i);
+					start = i + 1;
+				}
+			}
+			bounds.push_back(start);
+			bounds.push_back(len);
+		}
+#endif
+
+#ifdef ZULIB_AVX2
+		ZULIB_TARGET_AVX2 void split_fields_avx2(const char *data, size_t len, char delim, std::vector<size_t> &bounds)
+		{
+			const __m256i d = _mm256_set1_epi8(delim);
+			size_t start = 0;
+			size_t i = 0;
+			for (; i + 32 <= len; i += 32)
+			{
+				__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, d)));
+				while (mask)
+				{
+					const size_t pos = i + lowest_bit(mask);
+					bounds.push_back(start);
+					bounds.push_back(pos);
+					start = pos + 1;
+					mask &= mask - 1;
+				}
+			}
+			for (; i < len; i++)
+			{
+				if (data[i] == delim)
+				{
+					bounds.push_back(start);
+					bounds.push_back(i);
+					start = i + 1;
+				}
+			}
+			bounds.push_back(start);
+			bounds.push_back(len);
+		}
+#endif
+
+		typedef void(*SplitFieldsFunc)(const char*, size_t, char, std::vector<size_t>&);
+
+		SplitFieldsFunc select_split_fields()
+		{
+#ifdef ZULIB_AVX2
+			if (cpu_has_avx2())
+				return split_fields_avx2;
+#endif
+#ifdef ZULIB_SSE2
+			return split_fields_sse2;
+#else
+			return split_fields_scalar;
+#endif
+		}
+
+		void split_fields(const char *data, size_t len, char delim, std::vector<size_t> &bounds)
+		{
+			static SplitFieldsFunc func = NULL;
+			if (func == NULL)
+				func = select_split_fields();
+			func(data, len, delim, bounds);
+		}
+	}
+
+	DelimitedReader::DelimitedReader(TextFile &file, char delimiter, char quote)
+		: file_(file), delimiter_(delimiter), quote_(quote), data_(NULL), size_(0), lineNo_(0)
+	{
+		if (delimiter == quote)
+			throw ArgException("Delimiter and quote must be different!");
+	}
+
+	int DelimitedReader::next_record()
+	{
+		LineRef line;
+		int ret = file_.next_line(line);
+		if (ret <= 0)
+		{
+			bounds_.clear();
+			escaped_.clear();
+			return ret;
+		}
+
+		data_ = line.data;
+		size_ = line.size;
+		lineNo_ = line.lineNo;
+		if (split())
+			return 1;
+
+		// quoted field continues on next lines, the line buffer may be reused so copy them
+		record_.assign(line.data, line.size);
+		data_ = record_.data();
+		size_ = record_.size();
+		for (;;)
+		{
+			if (file_.next_line(line) <= 0)
+			{
+				// unclosed quote at end of file, take the rest as is
+				split();
+				break;
+			}
+			record_.push_back('\n');
+			record_.append(line.data, line.size);
+			data_ = record_.data();
+			size_ = record_.size();
+			if (split())
+				break;
+		}
+		return 1;
+	}
+
+	bool DelimitedReader::split()
+	{
+		bounds_.clear();
+		escaped_.clear();
+
+		// fast path, one SIMD pass over the whole line
+		if (quote_ == '\0' || memchr(data_, quote_, size_) == NULL)
+		{
+			split_fields(data_, size_, delimiter_, bounds_);
+			escaped_.resize(bounds_.size() / 2, 0);
+			return true;
+		}
+
+		bool closed = true;
+		size_t start = 0;
+		for (;;)
+		{
+			size_t begin = start;
+			size_t end;
+			size_t next = start;
+			char escaped = 0;
+			if (start < size_ && data_[start] == quote_)
+			{
+				// quoted field, "" stands for one quote
+				begin = start + 1;
+				end = size_;
+				next = size_;
+				closed = false;
+				for (size_t i = begin; i < size_;)
+				{
+					const char *q = static_cast<const char*>(memchr(data_ + i, quote_, size_ - i));
+					if (q == NULL)
+						break;
+					const size_t pos = q - data_;
+					if (pos + 1 < size_ && data_[pos + 1] == quote_)
+					{
+						escaped = 1;
+						i = pos + 2;
+						continue;
+					}
+					end = pos;
+					next = pos + 1;
+					closed = true;
+					break;
+				}
+			}
+
+			// characters between closing quote and delimiter are ignored
+			const char *d = (next < size_) ? static_cast<const char*>(memchr(data_ + next, delimiter_, size_ - next)) : NULL;
+			if (begin == start)
+				end = (d == NULL) ? size_ : d - data_;
+
+			bounds_.push_back(begin);
+			bounds_.push_back(end);
+			escaped_.push_back(escaped);
+			if (d == NULL)
+				break;
+			start = (d - data_) + 1;
+		}
+		return closed;
+	}
+
+	String DelimitedReader::str(size_t i) const
+	{
+		String ret(field(i), field_size(i));
+		if (is_escaped(i))
+		{
+			const char q[3] = { quote_, quote_, '\0' };
+			size_t pos = 0;
+			while ((pos = ret.find(q, pos)) != String::npos)
+			{
+				ret.erase(pos, 1);
+				pos++;
+			}
+		}
+		return ret;
+	}
+
+	bool DelimitedReader::to_int(size_t i, int64 &value) const
+	{
+		const char *p = field(i);
+		const char *end = p + field_size(i);
+		while (p < end && isspace(static_cast<uchar>(*p))) p++;
+		while (end > p && isspace(static_cast<uchar>(*(end - 1)))) end--;
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = (*p == '-');
+			p++;
+		}
+		if (p == end)
+			return false;
+
+		uint64 v = 0;
+		const uint64 limit = negative ? static_cast<uint64>(LLONG_MAX) + 1 : static_cast<uint64>(LLONG_MAX);
+		for (; p < end; p++)
+		{
+			const unsigned int digit = static_cast<unsigned int>(*p - '0');
+			if (digit > 9 || v > (limit - digit) / 10)
+				return false;
+			v = v * 10 + digit;
+		}
+		value = negative ? static_cast<int64>(0 - v) : static_cast<int64>(v);
+		return true;
+	}
+
+	bool DelimitedReader::to_double(size_t i, double &value) const
+	{
+		// strtod needs a terminated string, short fields are copied on stack
+		const size_t len = field_size(i);
+		char stackBuf[64];
+		String heapBuf;
+		const char *str;
+		if (len < sizeof(stackBuf))
+		{
+			memcpy(stackBuf, field(i), len);
+			stackBuf[len] = '\0';
+			str = stackBuf;
+		}
+		else
+		{
+			heapBuf.assign(field(i), len);
+			str = heapBuf.c_str();
+		}
+
+		char *end;
+		errno = 0;
+		const double v = strtod(str, &end);
+		if (end == str || errno == ERANGE)
+			return false;
+		while (isspace(static_cast<uchar>(*end))) end++;
+		if (*end != '\0')
+			return false;
+		value = v;
+		return true;
+	}
+
+	namespace
+	{
+		void byte_swap_scalar(char *data, size_t count, size_t elemSize)
+		{
+			for (size_t i = 0; i < count; i++, data += elemSize)
+			{
+				std::reverse(data, data + elemSize);
+			}
+		}
+
+#ifdef ZULIB_SSE2
+		// swap bytes inside each 16 bit lane
+		inline __m128i swap16_sse2(__m128i v)
+		{
+			return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		}
+
+		void byte_swap_sse2(char *data, size_t count, size_t elemSize)
+		{
+			const size_t len = count * elemSize;
+			size_t i = 0;
+			for (; i + 16 <= len; i += 16)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				if (elemSize == 4)
+				{
+					v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+				}
+				else if (elemSize == 8)
+				{
+					v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3)), _MM_SHUFFLE(0, 1, 2, 3));
+				}
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), swap16_sse2(v));
+			}
+			byte_swap_scalar(data + i, (len - i) / elemSize, elemSize);
+		}
+#endif
+
+#ifdef ZULIB_AVX2
+		ZULIB_TARGET_AVX2 void byte_swap_avx2(char *data, size_t count, size_t elemSize)
+		{
+			static const char masks[3][16] = {
+				{ 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+				{ 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+				{ 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 } };
+			const char *m = masks[elemSize == 2 ? 0 : (elemSize == 4 ? 1 : 2)];
+			const __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m));
+			const __m256i mask = _mm256_inserti128_si256(_mm256_castsi128_si256(half), half, 1);
+			const size_t len = count * elemSize;
+			size_t i = 0;
+			for (; i + 32 <= len; i += 32)
+			{
+				__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_shuffle_epi8(v, mask));
+			}
+			byte_swap_scalar(data + i, (len - i) / elemSize, elemSize);
+		}
+#endif
+
+		typedef void(*ByteSwapFunc)(char*, size_t, size_t);
+
+		ByteSwapFunc select_byte_swap()
+		{
+#ifdef ZULIB_AVX2
+			if (cpu_has_avx2())
+				return byte_swap_avx2;
+#endif
+#ifdef ZULIB_SSE2
+			return byte_swap_sse2;
+#else
+			return byte_swap_scalar;
+#endif
+		}
+
+		int sys_open(const String &path, std::ios_base::openmode openmode)
+		{
+			const bool writable = (openmode & (std::ios_base::out | std::ios_base::app)) != 0;
+			const bool readable = (openmode & std::ios_base::in) != 0;
+#if ZULIB_OS == 0
+			int flags = _O_BINARY | (writable ? (readable ? _O_RDWR : _O_WRONLY) : _O_RDONLY);
+			return _open(path.c_str(), flags);
+#else
+			int flags = writable ? (readable ? O_RDWR : O_WRONLY) : O_RDONLY;
+			return ::open(path.c_str(), flags);
+#endif
+		}
+	}
+
+	void byte_swap(void *data, size_t count, size_t elemSize)
+	{
+		if (elemSize < 2)
+			return;
+
+		static ByteSwapFunc func = NULL;
+		if (func == NULL)
+			func = select_byte_swap();
+
+		if (elemSize == 2 || elemSize == 4 || elemSize == 8)
+			func(static_cast<char*>(data), count, elemSize);
+		else
+			byte_swap_scalar(static_cast<char*>(data), count, elemSize);
+	}
+
+	bool is_little_endian()
+	{
+		const unsigned int one = 1;
+		return *reinterpret_cast<const char*>(&one) == 1;
+	}
+
+	namespace
+	{
+		const unsigned int CRC32C_POLY = 0x82F63B78;	// reflected Castagnoli polynomial
+		const size_t CRC32C_LONG = 8192;	// stream lengths of the interleaved hardware crc
+		const size_t CRC32C_SHORT = 256;
+
+		// multiply a 32x32 GF(2) matrix with a vector
+		unsigned int gf2_matrix_times(const unsigned int *mat, unsigned int vec)
+		{
+			unsigned int sum = 0;
+			for (; vec != 0; vec >>= 1, mat++)
+			{
+				if (vec & 1)
+					sum ^= *mat;
+			}
+			return sum;
+		}
+
+		void gf2_matrix_square(unsigned int *square, const unsigned int *mat)
+		{
+			for (int n = 0; n < 32; n++)
+			{
+				square[n] = gf2_matrix_times(mat, mat[n]);
+			}
+		}
+
+		// tables which advance a crc over len zero bytes, len a power of 2, so crcs of
+		// adjacent streams can be combined
+		void crc32c_zeros(unsigned int zeros[4][256], size_t len)
+		{
+			unsigned int odd[32], even[32];
+			odd[0] = CRC32C_POLY;	// one zero bit
+			for (int n = 1; n < 32; n++)
+			{
+				odd[n] = 1U << (n - 1);
+			}
+			gf2_matrix_square(even, odd);	// two zero bits
+			gf2_matrix_square(odd, even);	// four zero bits
+
+			// squaring doubles the length, starting at one byte
+			const unsigned int *op = even;
+			do
+			{
+				gf2_matrix_square(even, odd);
+				op = even;
+				len >>= 1;
+				if (len == 0)
+					break;
+				gf2_matrix_square(odd, even);
+				op = odd;
+				len >>= 1;
+			} while (len != 0);
+
+			for (unsigned int n = 0; n < 256; n++)
+			{
+				zeros[0][n] = gf2_matrix_times(op, n);
+				zeros[1][n] = gf2_matrix_times(op, n << 8);
+				zeros[2][n] = gf2_matrix_times(op, n << 16);
+				zeros[3][n] = gf2_matrix_times(op, n << 24);
+			}
+		}
+
+		inline unsigned int crc32c_shift(const unsigned int zeros[4][256], unsigned int crc)
+		{
+			return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^ zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+		}
+
+		struct Crc32cTables
+		{
+			unsigned int slice[8][256];		// slicing-by-8 software tables
+			unsigned int shiftLong[4][256];
+			unsigned int shiftShort[4][256];
+
+			Crc32cTables()
+			{
+				for (unsigned int n = 0; n < 256; n++)
+				{
+					unsigned int crc = n;
+					for (int k = 0; k < 8; k++)
+					{
+						crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+					}
+					slice[0][n] = crc;
+				}
+				for (unsigned int n = 0; n < 256; n++)
+				{
+					for (int k = 1; k < 8; k++)
+					{
+						slice[k][n] = (slice[k - 1][n] >> 8) ^ slice[0][slice[k - 1][n] & 0xff];
+					}
+				}
+				crc32c_zeros(shiftLong, CRC32C_LONG);
+				crc32c_zeros(shiftShort, CRC32C_SHORT);
+			}
+		};
+
+		const Crc32cTables& crc32c_tables()
+		{
+			// built once by the thread safe initialization of local statics
+			static const Crc32cTables tables;
+			return tables;
+		}
+
+		unsigned int crc32c_sw(unsigned int crc, const uchar *p, size_t len)
+		{
+			const Crc32cTables &t = crc32c_tables();
+			crc = ~crc;
+			for (; len >= 8; len -= 8, p += 8)
+			{
+				const unsigned int lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<unsigned int>(p[3]) << 24));
+				const unsigned int hi = p[4] | (p[5] << 8) | (p[6] << 16) | (static_cast<unsigned int>(p[7]) << 24);
+				crc = t.slice[7][lo & 0xff] ^ t.slice[6][(lo >> 8) & 0xff] ^ t.slice[5][(lo >> 16) & 0xff] ^ t.slice[4][lo >> 24]
+					^ t.slice[3][hi & 0xff] ^ t.slice[2][(hi >> 8) & 0xff] ^ t.slice[1][(hi >> 16) & 0xff] ^ t.slice[0][hi >> 24];
+			}
+			for (; len > 0; len--, p++)
+			{
+				crc = (crc >> 8) ^ t.slice[0][(crc ^ *p) & 0xff];
+			}
+			return ~crc;
+		}
+
+#ifdef ZULIB_SSE42
+		inline uint64 crc32c_load(const uchar *p)
+		{
+			uint64 v;
+			memcpy(&v, p, sizeof(v));
+			return v;
+		}
+
+		// three independent crc32 instructions per cycle hide their latency, the three
+		// stream crcs are combined with the zero shift tables
+		ZULIB_TARGET_SSE42 unsigned int crc32c_hw(unsigned int crc, const uchar *p, size_t len)
+		{
+			const Crc32cTables &t = crc32c_tables();
+			uint64 crc0 = ~crc;
+			for (; len > 0 && (reinterpret_cast<size_t>(p) & 7) != 0; len--, p++)
+			{
+				crc0 = _mm_crc32_u8(static_cast<unsigned int>(crc0), *p);
+			}
+
+			const size_t streams[2] = { CRC32C_LONG, CRC32C_SHORT };
+			for (int s = 0; s < 2; s++)
+			{
+				const size_t n = streams[s];
+				const unsigned int (*shift)[256] = s == 0 ? t.shiftLong : t.shiftShort;
+				while (len >= 3 * n)
+				{
+					uint64 crc1 = 0, crc2 = 0;
+					const uchar *end = p + n;
+					do
+					{
+						crc0 = _mm_crc32_u64(crc0, crc32c_load(p));
+						crc1 = _mm_crc32_u64(crc1, crc32c_load(p + n));
+						crc2 = _mm_crc32_u64(crc2, crc32c_load(p + 2 * n));
+						p += 8;
+					} while (p < end);
+					crc0 = crc32c_shift(shift, static_cast<unsigned int>(crc0)) ^ crc1;
+					crc0 = crc32c_shift(shift, static_cast<unsigned int>(crc0)) ^ crc2;
+					p += 2 * n;
+					len -= 3 * n;
+				}
+			}
+
+			for (; len >= 8; len -= 8, p += 8)
+			{
+				crc0 = _mm_crc32_u64(crc0, crc32c_load(p));
+			}
+			for (; len > 0; len--, p++)
+			{
+				crc0 = _mm_crc32_u8(static_cast<unsigned int>(crc0), *p);
+			}
+			return ~static_cast<unsigned int>(crc0);
+		}
+
+		bool cpu_has_sse42()
+		{
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 1);
+			return (info[2] & (1 << 20)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse4.2") != 0;
+#endif
+		}
+#endif
+
+		typedef unsigned int(*Crc32cFunc)(unsigned int, const uchar*, size_t);
+
+		Crc32cFunc select_crc32c()
+		{
+#ifdef ZULIB_SSE42
+			if (cpu_has_sse42())
+				return crc32c_hw;
+#endif
+			return crc32c_sw;
+		}
+
+		const uint64 XXH_PRIME1 = 0x9E3779B185EBCA87ULL;
+		const uint64 XXH_PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+		const uint64 XXH_PRIME3 = 0x165667B19E3779F9ULL;
+		const uint64 XXH_PRIME4 = 0x85EBCA77C2B2AE63ULL;
+		const uint64 XXH_PRIME5 = 0x27D4EB2F165667C5ULL;
+
+		inline uint64 xxh_rotl(uint64 v, int r)
+		{
+			return (v << r) | (v >> (64 - r));
+		}
+
+		// little endian loads, hashes are the same on every machine
+		inline uint64 xxh_read64(const uchar *p)
+		{
+			uint64 v;
+			memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			v = __builtin_bswap64(v);
+#endif
+			return v;
+		}
+
+		inline uint64 xxh_read32(const uchar *p)
+		{
+			return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint64>(p[3]) << 24);
+		}
+
+		inline uint64 xxh_round(uint64 acc, uint64 input)
+		{
+			acc += input * XXH_PRIME2;
+			return xxh_rotl(acc, 31) * XXH_PRIME1;
+		}
+
+		inline uint64 xxh_merge(uint64 h, uint64 acc)
+		{
+			h ^= xxh_round(0, acc);
+			return h * XXH_PRIME1 + XXH_PRIME4;
+		}
+
+		// consume whole 32 byte stripes, return bytes consumed
+		size_t xxh_stripes(uint64 acc[4], const uchar *p, size_t len)
+		{
+			const uchar *begin = p;
+			for (; len >= 32; len -= 32, p += 32)
+			{
+				acc[0] = xxh_round(acc[0], xxh_read64(p));
+				acc[1] = xxh_round(acc[1], xxh_read64(p + 8));
+				acc[2] = xxh_round(acc[2], xxh_read64(p + 16));
+				acc[3] = xxh_round(acc[3], xxh_read64(p + 24));
+			}
+			return static_cast<size_t>(p - begin);
+		}
+
+		// final mix of accumulators and the last partial stripe
+		uint64 xxh_digest(const uint64 acc[4], uint64 seed, uint64 total, const uchar *p, size_t len)
+		{
+			uint64 h;
+			if (total >= 32)
+			{
+				h = xxh_rotl(acc[0], 1) + xxh_rotl(acc[1], 7) + xxh_rotl(acc[2], 12) + xxh_rotl(acc[3], 18);
+				for (int i = 0; i < 4; i++)
+				{
+					h = xxh_merge(h, acc[i]);
+				}
+			}
+			else
+			{
+				h = seed + XXH_PRIME5;
+			}
+			h += total;
+
+			for (; len >= 8; len -= 8, p += 8)
+			{
+				h ^= xxh_round(0, xxh_read64(p));
+				h = xxh_rotl(h, 27) * XXH_PRIME1 + XXH_PRIME4;
+			}
+			if (len >= 4)
+			{
+				h ^= xxh_read32(p) * XXH_PRIME1;
+				h = xxh_rotl(h, 23) * XXH_PRIME2 + XXH_PRIME3;
+				len -= 4;
+				p += 4;
+			}
+			for (; len > 0; len--, p++)
+			{
+				h ^= *p * XXH_PRIME5;
+				h = xxh_rotl(h, 11) * XXH_PRIME1;
+			}
+
+			h ^= h >> 33;
+			h *= XXH_PRIME2;
+			h ^= h >> 29;
+			h *= XXH_PRIME3;
+			h ^= h >> 32;
+			return h;
+		}
+
+		void xxh_init(uint64 acc[4], uint64 seed)
+		{
+			acc[0] = seed + XXH_PRIME1 + XXH_PRIME2;
+			acc[1] = seed + XXH_PRIME2;
+			acc[2] = seed;
+			acc[3] = seed - XXH_PRIME1;
+		}
+	}
+
+	unsigned int crc32c(const void *data, size_t len, unsigned int crc)
+	{
+		// resolved once, racing threads would store the same value
+		static Crc32cFunc func = NULL;
+		if (func == NULL)
+			func = select_crc32c();
+		return func(crc, static_cast<const uchar*>(data), len);
+	}
+
+	uint64 xxhash64(const void *data, size_t len, uint64 seed)
+	{
+		const uchar *p = static_cast<const uchar*>(data);
+		uint64 acc[4];
+		xxh_init(acc, seed);
+		const size_t n = xxh_stripes(acc, p, len);
+		return xxh_digest(acc, seed, len, p + n, len - n);
+	}
+
+	Checksum::Checksum(int type, uint64 seed)
+	{
+		if (type != NONE && type != CRC32C && type != XXH64)
+			throw ArgException("Invalid checksum type!");
+
+		type_ = type;
+		seed_ = seed;
+		reset();
+	}
+
+	void Checksum::reset()
+	{
+		total_ = 0;
+		crc_ = static_cast<unsigned int>(seed_);
+		xxh_init(acc_, seed_);
+		stripeLen_ = 0;
+	}
+
+	void Checksum::update(const void *data, size_t len)
+	{
+		const uchar *p = static_cast<const uchar*>(data);
+		total_ += len;
+		if (type_ == CRC32C)
+		{
+			crc_ = crc32c(p, len, crc_);
+			return;
+		}
+		if (type_ != XXH64)
+			return;
+
+		// complete a partial stripe first
+		if (stripeLen_ > 0)
+		{
+			const size_t n = min(len, sizeof(stripe_) - stripeLen_);
+			memcpy(stripe_ + stripeLen_, p, n);
+			stripeLen_ += n;
+			p += n;
+			len -= n;
+			if (stripeLen_ < sizeof(stripe_))
+				return;
+			xxh_stripes(acc_, stripe_, sizeof(stripe_));
+			stripeLen_ = 0;
+		}
+
+		const size_t n = xxh_stripes(acc_, p, len);
+		memcpy(stripe_, p + n, len - n);
+		stripeLen_ = len - n;
+	}
+
+	uint64 Checksum::value() const
+	{
+		if (type_ == CRC32C)
+			return crc_;
+		if (type_ == XXH64)
+			return xxh_digest(acc_, seed_, total_, stripe_, stripeLen_);
+		return 0;
+	}
+
+	uint64 hash_file(const String &path, int type)
+	{
+		Checksum sum(type);
+		ReadAhead reader;
+		if (!reader.start(path, 0, 4 * 1024 * 1024, 3))
+			throw IOException(TO_STRING("Failed to open file: " << path));
+
+		// hash blocks in place while the worker reads the next ones
+		size_t len = 0;
+		const char *data;
+		while ((data = reader.acquire(len)) != NULL)
+		{
+			sum.update(data, len);
+			reader.release(len);
+		}
+		return sum.value();
+	}
+
+	AlignedBuffer::AlignedBuffer(size_t size, size_t alignment)
+	{
+		if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment % sizeof(void*) != 0)
+			throw ArgException("Alignment must be a power of 2 multiple of pointer size!");
+
+		data_ = NULL;
+		size_ = capacity_ = 0;
+		alignment_ = alignment;
+		resize(size);
+	}
+
+	void AlignedBuffer::resize(size_t size)
+	{
+		if (size > capacity_)
+		{
+			void *mem = NULL;
+#if ZULIB_OS == 0
+			mem = _aligned_malloc(size, alignment_);
+#else
+			if (posix_memalign(&mem, alignment_, size) != 0)
+				mem = NULL;
+#endif
+			if (mem == NULL)
+				throw RuntimeException(TO_STRING("Failed to allocate aligned buffer of " << size << " bytes."));
+
+			if (size_ > 0)
+				memcpy(mem, data_, size_);
+			release();
+			data_ = static_cast<char*>(mem);
+			capacity_ = size;
+		}
+		size_ = size;
+	}
+
+	void AlignedBuffer::release()
+	{
+		if (data_ != NULL)
+		{
+#if ZULIB_OS == 0
+			_aligned_free(data_);
+#else
+			free(data_);
+#endif
+		}
+		data_ = NULL;
+		size_ = capacity_ = 0;
+	}
+
+	namespace
+	{
+		struct AsyncReaderImpl
+		{
+			String	path;
+#if ZULIB_OS == 0
+			HANDLE	file;
+#else
+			int		fd;
+#endif
+			size_t	pending;	// submitted and not collected yet
+
+			// worker pool
+			Mutex	mutex;
+			CondVar	queued;
+			CondVar	completed;
+			std::deque<AsyncRead*>	queue;
+			std::deque<AsyncRead*>	done;
+			Thread	*workers;
+			int		numWorkers;
+			bool	stop;
+
+			bool	uring;
+#ifdef ZULIB_IO_URING
+			int		ringFd;
+			void	*sqRing;
+			size_t	sqRingSize;
+			void	*cqRing;
+			size_t	cqRingSize;
+			struct io_uring_sqe	*sqes;
+			size_t	sqesSize;
+			unsigned	*sqHead;
+			unsigned	*sqTail;
+			unsigned	*sqArray;
+			unsigned	sqMask;
+			unsigned	sqEntries;
+			unsigned	*cqHead;
+			unsigned	*cqTail;
+			struct io_uring_cqe	*cqes;
+			unsigned	cqMask;
+			unsigned	toSubmit;	// filled entries not consumed by the kernel yet
+			std::vector<AsyncRead*>	slots;	// request in flight of each slot
+			std::vector<struct iovec>	iovecs;
+			std::vector<unsigned>	freeSlots;
+			std::deque<AsyncRead*>	backlog;	// waiting for a free slot
+#endif
+		};
+
+		// read until size bytes, end of file or error
+		void async_read_request(AsyncReaderImpl &impl, AsyncRead &req)
+		{
+			char *dst = static_cast<char*>(req.data);
+			while (req.bytes < req.size)
+			{
+				const size_t want = min<size_t>(req.size - req.bytes, 1 << 30);
+#if ZULIB_OS == 0
+				OVERLAPPED ov;
+				memset(&ov, 0, sizeof(ov));
+				const uint64 pos = req.offset + req.bytes;
+				ov.Offset = static_cast<DWORD>(pos & 0xFFFFFFFF);
+				ov.OffsetHigh = static_cast<DWORD>(pos >> 32);
+				DWORD nbuf = 0;
+				if (!ReadFile(impl.file, dst + req.bytes, static_cast<DWORD>(want), &nbuf, &ov))
+				{
+					if (GetLastError() != ERROR_HANDLE_EOF)
+						req.error = static_cast<int>(GetLastError());
+					return;
+				}
+#else
+				ssize_t nbuf = ::pread(impl.fd, dst + req.bytes, want, static_cast<off_t>(req.offset + req.bytes));
+				if (nbuf < 0 && errno == EINTR)
+					continue;
+				if (nbuf < 0)
+				{
+					req.error = errno;
+					return;
+				}
+#endif
+				if (nbuf == 0)
+					return;
+				req.bytes += static_cast<size_t>(nbuf);
+			}
+		}
+
+		void async_read_worker(void *arg)
+		{
+			AsyncReaderImpl &impl = *static_cast<AsyncReaderImpl*>(arg);
+			for (;;)
+			{
+				AsyncRead *req;
+				{
+					ScopedLock lock(impl.mutex);
+					while (impl.queue.empty() && !impl.stop)
+					{
+						impl.queued.wait(impl.mutex);
+					}
+					if (impl.queue.empty())
+						return;
+					req = impl.queue.front();
+					impl.queue.pop_front();
+				}
+
+				async_read_request(impl, *req);
+
+				ScopedLock lock(impl.mutex);
+				impl.done.push_back(req);
+				impl.completed.notify_one();
+			}
+		}
+
+#ifdef ZULIB_IO_URING
+		int uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+		{
+			return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0));
+		}
+
+		bool uring_setup(AsyncReaderImpl &impl, int depth)
+		{
+			struct io_uring_params params;
+			memset(&params, 0, sizeof(params));
+			impl.ringFd = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(depth), &params));
+			if (impl.ringFd < 0)
+				return false;
+
+			impl.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			impl.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+			impl.sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+			impl.sqRing = mmap(NULL, impl.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, impl.ringFd, IORING_OFF_SQ_RING);
+			impl.cqRing = mmap(NULL, impl.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, impl.ringFd, IORING_OFF_CQ_RING);
+			void *sqes = mmap(NULL, impl.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, impl.ringFd, IORING_OFF_SQES);
+			if (impl.sqRing == MAP_FAILED || impl.cqRing == MAP_FAILED || sqes == MAP_FAILED)
+			{
+				if (impl.sqRing != MAP_FAILED) munmap(impl.sqRing, impl.sqRingSize);
+				if (impl.cqRing != MAP_FAILED) munmap(impl.cqRing, impl.cqRingSize);
+				if (sqes != MAP_FAILED) munmap(sqes, impl.sqesSize);
+				::close(impl.ringFd);
+				impl.ringFd = -1;
+				return false;
+			}
+
+			char *sq = static_cast<char*>(impl.sqRing);
+			char *cq = static_cast<char*>(impl.cqRing);
+			impl.sqes = static_cast<struct io_uring_sqe*>(sqes);
+			impl.sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+			impl.sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+			impl.sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+			impl.sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+			impl.sqEntries = params.sq_entries;
+			impl.cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+			impl.cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+			impl.cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+			impl.cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+			impl.toSubmit = 0;
+
+			// the kernel usually doubles the completion ring, in flight reads are still
+			// limited to depth, which also keeps completions from overflowing
+			const unsigned inFlight = min(static_cast<unsigned>(depth), params.cq_entries);
+			impl.slots.assign(inFlight, NULL);
+			impl.iovecs.resize(inFlight);
+			impl.freeSlots.clear();
+			for (unsigned i = inFlight; i > 0; i--)
+			{
+				impl.freeSlots.push_back(i - 1);
+			}
+			return true;
+		}
+
+		void uring_teardown(AsyncReaderImpl &impl)
+		{
+			munmap(impl.sqes, impl.sqesSize);
+			munmap(impl.sqRing, impl.sqRingSize);
+			munmap(impl.cqRing, impl.cqRingSize);
+			::close(impl.ringFd);
+		}
+
+		// move backlog into free slots and hand them to the kernel
+		void uring_pump(AsyncReaderImpl &impl)
+		{
+			unsigned tail = *impl.sqTail;
+			const unsigned head = __atomic_load_n(impl.sqHead, __ATOMIC_ACQUIRE);
+			while (!impl.backlog.empty() && !impl.freeSlots.empty() && tail - head < impl.sqEntries)
+			{
+				AsyncRead *req = impl.backlog.front();
+				impl.backlog.pop_front();
+				const unsigned slot = impl.freeSlots.back();
+				impl.freeSlots.pop_back();
+				impl.slots[slot] = req;
+
+				// continue after bytes already read, for short reads
+				struct iovec &iov = impl.iovecs[slot];
+				iov.iov_base = static_cast<char*>(req->data) + req->bytes;
+				iov.iov_len = req->size - req->bytes;
+
+				const unsigned idx = tail & impl.sqMask;
+				struct io_uring_sqe &sqe = impl.sqes[idx];
+				memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode = IORING_OP_READV;
+				sqe.fd = impl.fd;
+				sqe.off = req->offset + req->bytes;
+				sqe.addr = reinterpret_cast<unsigned long>(&iov);
+				sqe.len = 1;
+				sqe.user_data = slot;
+				impl.sqArray[idx] = idx;
+				tail++;
+				impl.toSubmit++;
+			}
+			__atomic_store_n(impl.sqTail, tail, __ATOMIC_RELEASE);
+
+			while (impl.toSubmit > 0)
+			{
+				const int ret = uring_enter(impl.ringFd, impl.toSubmit, 0, 0);
+				if (ret < 0 && errno == EINTR)
+					continue;
+				if (ret < 0 && (errno == EAGAIN || errno == EBUSY))
+					break;	// retried after completions are reaped
+				if (ret < 0)
+					throw IOException(TO_STRING("Failed to submit reads: " << impl.path));
+				impl.toSubmit -= static_cast<unsigned>(ret);
+				if (ret == 0)
+					break;
+			}
+		}
+
+		size_t uring_reap(AsyncReaderImpl &impl, AsyncRead **done, size_t max)
+		{
+			size_t n = 0;
+			unsigned head = *impl.cqHead;
+			const unsigned tail = __atomic_load_n(impl.cqTail, __ATOMIC_ACQUIRE);
+			while (head != tail && n < max)
+			{
+				const struct io_uring_cqe &cqe = impl.cqes[head & impl.cqMask];
+				const unsigned slot = static_cast<unsigned>(cqe.user_data);
+				AsyncRead *req = impl.slots[slot];
+				impl.slots[slot] = NULL;
+				impl.freeSlots.push_back(slot);
+				head++;
+
+				if (cqe.res < 0)
+				{
+					req->error = -cqe.res;
+				}
+				else
+				{
+					req->bytes += static_cast<size_t>(cqe.res);
+					if (cqe.res > 0 && req->bytes < req->size)
+					{
+						// short read before end of file, read the rest
+						impl.backlog.push_front(req);
+						continue;
+					}
+				}
+				done[n++] = req;
+			}
+			__atomic_store_n(impl.cqHead, head, __ATOMIC_RELEASE);
+			impl.pending -= n;
+			return n;
+		}
+#endif
+	}
+
+	bool AsyncReader::open(const String &path, int depth, int useUring)
+	{
+		close();
+		depth = max(depth, 1);
+
+		AsyncReaderImpl *impl = new AsyncReaderImpl;
+		impl->path = path;
+		impl->pending = 0;
+		impl->workers = NULL;
+		impl->numWorkers = 0;
+		impl->stop = false;
+		impl->uring = false;
+#if ZULIB_OS == 0
+		impl->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+			NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+		if (impl->file == INVALID_HANDLE_VALUE)
+		{
+			delete impl;
+			return false;
+		}
+#else
+		impl->fd = ::open(path.c_str(), O_RDONLY);
+		if (impl->fd < 0)
+		{
+			delete impl;
+			return false;
+		}
+#endif
+
+#ifdef ZULIB_IO_URING
+		impl->uring = useUring > 0 && uring_setup(*impl, depth);
+#else
+		unused(useUring);
+#endif
+		if (!impl->uring)
+		{
+			// blocking reads, one worker per request in flight
+			impl->numWorkers = min(depth, 64);
+			impl->workers = new Thread[impl->numWorkers];
+			for (int i = 0; i < impl->numWorkers; i++)
+			{
+				try
+				{
+					impl->workers[i].start(async_read_worker, impl);
+				}
+				catch (...)
+				{
+					// stop and join the started workers before impl is freed
+					{
+						ScopedLock lock(impl->mutex);
+						impl->stop = true;
+						impl->queued.notify_all();
+					}
+					delete[] impl->workers;
+#if ZULIB_OS == 0
+					CloseHandle(impl->file);
+#else
+					::close(impl->fd);
+#endif
+					delete impl;
+					throw;
+				}
+			}
+		}
+
+		impl_ = impl;
+		return true;
+	}
+
+	void AsyncReader::close()
+	{
+		if (impl_ == NULL)
+			return;
+
+		AsyncReaderImpl *impl = static_cast<AsyncReaderImpl*>(impl_);
+		// the kernel or workers may still write to caller buffers, wait for them
+		std::vector<AsyncRead*> done(64);
+		while (impl->pending > 0)
+		{
+			try
+			{
+				wait(&done.front(), done.size());
+			}
+			catch (...)
+			{
+				break;
+			}
+		}
+
+		if (impl->workers != NULL)
+		{
+			{
+				ScopedLock lock(impl->mutex);
+				impl->stop = true;
+				impl->queued.notify_all();
+			}
+			for (int i = 0; i < impl->numWorkers; i++)
+			{
+				impl->workers[i].join();
+			}
+			delete[] impl->workers;
+		}
+#ifdef ZULIB_IO_URING
+		if (impl->uring)
+			uring_teardown(*impl);
+#endif
+#if ZULIB_OS == 0
+		CloseHandle(impl->file);
+#else
+		::close(impl->fd);
+#endif
+		delete impl;
+		impl_ = NULL;
+	}
+
+	bool AsyncReader::is_uring() const
+	{
+		return impl_ != NULL && static_cast<AsyncReaderImpl*>(impl_)->uring;
+	}
+
+	size_t AsyncReader::pending() const
+	{
+		return impl_ == NULL ? 0 : static_cast<AsyncReaderImpl*>(impl_)->pending;
+	}
+
+	size_t AsyncReader::submit(AsyncRead *reads, size_t count)
+	{
+		if (impl_ == NULL)
+			throw RuntimeException("AsyncReader not opened!");
+
+		AsyncReaderImpl &impl = *static_cast<AsyncReaderImpl*>(impl_);
+		for (size_t i = 0; i < count; i++)
+		{
+			reads[i].bytes = 0;
+			reads[i].error = 0;
+		}
+
+#ifdef ZULIB_IO_URING
+		if (impl.uring)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				impl.backlog.push_back(reads + i);
+			}
+			impl.pending += count;
+			uring_pump(impl);
+			return count;
+		}
+#endif
+		ScopedLock lock(impl.mutex);
+		for (size_t i = 0; i < count; i++)
+		{
+			impl.queue.push_back(reads + i);
+		}
+		impl.pending += count;
+		impl.queued.notify_all();
+		return count;
+	}
+
+	size_t AsyncReader::poll(AsyncRead **done, size_t max)
+	{
+		if (impl_ == NULL || max == 0)
+			return 0;
+
+		AsyncReaderImpl &impl = *static_cast<AsyncReaderImpl*>(impl_);
+#ifdef ZULIB_IO_URING
+		if (impl.uring)
+		{
+			const size_t n = uring_reap(impl, done, max);
+			uring_pump(impl);
+			return n;
+		}
+#endif
+		ScopedLock lock(impl.mutex);
+		size_t n = 0;
+		while (n < max && !impl.done.empty())
+		{
+			done[n++] = impl.done.front();
+			impl.done.pop_front();
+		}
+		impl.pending -= n;
+		return n;
+	}
+
+	size_t AsyncReader::wait(AsyncRead **done, size_t max, int timeoutMs)
+	{
+		if (impl_ == NULL || max == 0)
+			return 0;
+
+		AsyncReaderImpl &impl = *static_cast<AsyncReaderImpl*>(impl_);
+		const double deadline = Timer::get_real_time() + timeoutMs / 1000.0;
+		for (;;)
+		{
+			if (impl.pending == 0)
+				return 0;
+
+			const size_t n = poll(done, max);
+			if (n > 0)
+				return n;
+
+			int remain = -1;
+			if (timeoutMs >= 0)
+			{
+				remain = static_cast<int>((deadline - Timer::get_real_time()) * 1000.0);
+				if (remain <= 0)
+					return 0;
+			}
+
+#ifdef ZULIB_IO_URING
+			if (impl.uring)
+			{
+				if (remain < 0)
+				{
+					const int ret = uring_enter(impl.ringFd, impl.toSubmit, 1, IORING_ENTER_GETEVENTS);
+					if (ret >= 0)
+						impl.toSubmit -= static_cast<unsigned>(ret);
+					else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+						throw IOException(TO_STRING("Failed to wait for reads: " << impl.path));
+				}
+				else
+				{
+					// the ring becomes readable when completions arrive
+					struct pollfd pfd;
+					pfd.fd = impl.ringFd;
+					pfd.events = POLLIN;
+					pfd.revents = 0;
+					::poll(&pfd, 1, remain);
+				}
+				continue;
+			}
+#endif
+			ScopedLock lock(impl.mutex);
+			if (impl.done.empty())
+			{
+				if (remain < 0)
+					impl.completed.wait(impl.mutex);
+				else
+					impl.completed.wait(impl.mutex, remain);
+			}
+		}
+	}
+
+	const size_t BinaryFile::DIRECT_ALIGNMENT;
+
+	BinaryFile::BinaryFile()
+	{
+		openmode_ |= std::ios_base::binary;
+		fd_ = fdDirect_ = -1;
+		cacheMode_ = CACHED;
+		endian_ = NATIVE;
+		swap_ = false;
+		pos_ = bufOffset_ = dirtyOffset_ = 0;
+		rlen_ = wlen_ = dirtyLen_ = 0;
+	}
+
+	BinaryFile::BinaryFile(String file, std::ios_base::openmode openmode, size_t bufferSize, int cacheMode)
+		: BaseFile(file, openmode | std::ios_base::binary)
+	{
+		fdDirect_ = -1;
+		cacheMode_ = CACHED;
+		endian_ = NATIVE;
+		swap_ = false;
+		pos_ = bufOffset_ = dirtyOffset_ = 0;
+		rlen_ = wlen_ = dirtyLen_ = 0;
+		// whole blocks, so the buffer can be used for direct IO
+		bufferSize = max<size_t>(bufferSize, DIRECT_ALIGNMENT);
+		buf_.resize(bufferSize + (DIRECT_ALIGNMENT - bufferSize % DIRECT_ALIGNMENT) % DIRECT_ALIGNMENT);
+
+		// the stream has created or truncated the file as requested, IO goes through a descriptor
+		fd_ = sys_open(path_, openmode_);
+		if (fd_ < 0)
+			throw IOException(TO_STRING("Failed to open file: " << path_));
+
+		if (openmode_ & std::ios_base::app)
+			pos_ = size();
+		set_cache_mode(cacheMode);
+	}
+
+	BinaryFile::~BinaryFile()
+	{
+		try
+		{
+			flush();
+		}
+		catch (...)
+		{
+		}
+
+		if (fd_ >= 0)
+		{
+			drop_cache(0, 0, true);
+#if ZULIB_OS == 0
+			_close(fd_);
+#else
+			::close(fd_);
+#endif
+		}
+		close_direct();
+	}
+
+	void BinaryFile::set_endian(int endian)
+	{
+		if (endian != NATIVE && endian != LITTLE && endian != BIG)
+			throw ArgException("Invalid endian!");
+
+		endian_ = endian;
+		swap_ = (endian == LITTLE && !is_little_endian()) || (endian == BIG && is_little_endian());
+	}
+
+	void BinaryFile::close_direct()
+	{
+#if ZULIB_OS == 1
+		if (fdDirect_ >= 0)
+			::close(fdDirect_);
+#endif
+		fdDirect_ = -1;
+	}
+
+	int BinaryFile::set_cache_mode(int mode)
+	{
+		if (mode != CACHED && mode != DIRECT && mode != STREAMING)
+			throw ArgException("Invalid cache mode!");
+
+		flush();
+		drop_cache(0, 0, true);
+		close_direct();
+		cacheMode_ = CACHED;
+
+#if ZULIB_OS == 1
+#ifdef O_DIRECT
+		if (mode == DIRECT)
+		{
+			const bool writable = (openmode_ & (std::ios_base::out | std::ios_base::app)) != 0;
+			const bool readable = (openmode_ & std::ios_base::in) != 0;
+			const int flags = writable ? (readable ? O_RDWR : O_WRONLY) : O_RDONLY;
+			fdDirect_ = ::open(path_.c_str(), flags | O_DIRECT);
+			if (fdDirect_ >= 0 && readable)
+			{
+				// some file systems accept the flag on open but fail the IO
+				if (bounce_.size() == 0)
+					bounce_.resize(256 * 1024);
+				if (::pread(fdDirect_, bounce_.data(), DIRECT_ALIGNMENT, 0) < 0 && errno == EINVAL)
+					close_direct();
+			}
+			if (fdDirect_ >= 0)
+			{
+				cacheMode_ = DIRECT;
+				return cacheMode_;
+			}
+		}
+#endif
+		if (mode != CACHED)
+		{
+#if defined(__APPLE__)
+			// no fadvise, caching is disabled per descriptor
+			if (fcntl(fd_, F_NOCACHE, 1) == 0)
+				cacheMode_ = STREAMING;
+#elif defined(POSIX_FADV_DONTNEED)
+			cacheMode_ = STREAMING;
+#endif
+		}
+#if defined(__APPLE__)
+		if (cacheMode_ == CACHED)
+			fcntl(fd_, F_NOCACHE, 0);
+#endif
+#endif
+		return cacheMode_;
+	}
+
+	void BinaryFile::drop_cache(uint64 offset, size_t len, bool written)
+	{
+#if ZULIB_OS == 1 && defined(POSIX_FADV_DONTNEED) && !defined(__APPLE__)
+		if (cacheMode_ != STREAMING)
+			return;
+
+		if (!written)
+		{
+			posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(len), POSIX_FADV_DONTNEED);
+			return;
+		}
+
+		// dirty pages can not be dropped, start writeback of the new range and drop
+		// the previous one once it is on disk, len 0 drops the last range only
+#if defined(__linux__)
+		if (len > 0)
+			sync_file_range(fd_, static_cast<off_t>(offset), static_cast<off_t>(len), SYNC_FILE_RANGE_WRITE);
+		if (dirtyLen_ > 0)
+		{
+			sync_file_range(fd_, static_cast<off_t>(dirtyOffset_), static_cast<off_t>(dirtyLen_),
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+			posix_fadvise(fd_, static_cast<off_t>(dirtyOffset_), static_cast<off_t>(dirtyLen_), POSIX_FADV_DONTNEED);
+		}
+#else
+		if (dirtyLen_ > 0)
+			posix_fadvise(fd_, static_cast<off_t>(dirtyOffset_), static_cast<off_t>(dirtyLen_), POSIX_FADV_DONTNEED);
+#endif
+		dirtyOffset_ = offset;
+		dirtyLen_ = len;
+#else
+		(void)offset;
+		(void)len;
+		(void)written;
+#endif
+	}
+
+	uint64 BinaryFile::size()
+	{
+#if ZULIB_OS == 0
+		struct __stat64 sb;
+		if (_fstat64(fd_, &sb) != 0)
+#else
+		struct stat sb;
+		if (fstat(fd_, &sb) != 0)
+#endif
+			throw IOException(TO_STRING("Failed to get size of file: " << path_));
+
+		return max(static_cast<uint64>(sb.st_size), bufOffset_ + wlen_);
+	}
+
+	size_t BinaryFile::pread_full(int fd, uint64 offset, void *dst, size_t len)
+	{
+		char *p = static_cast<char*>(dst);
+		size_t done = 0;
+		while (done < len)
+		{
+			const size_t want = min<size_t>(len - done, 1 << 30);
+#if ZULIB_OS == 0
+			int nbuf = -1;
+			if (_lseeki64(fd, static_cast<__int64>(offset + done), SEEK_SET) >= 0)
+				nbuf = _read(fd, p + done, static_cast<unsigned int>(want));
+#else
+			ssize_t nbuf = ::pread(fd, p + done, want, static_cast<off_t>(offset + done));
+			if (nbuf < 0 && errno == EINTR)
+				continue;
+#endif
+			if (nbuf < 0)
+				throw IOException(TO_STRING("Failed to read file: " << path_));
+			if (nbuf == 0)
+				break;
+			done += static_cast<size_t>(nbuf);
+			// a short direct read is end of file, retrying would be unaligned
+			if (fd == fdDirect_ && static_cast<size_t>(nbuf) < want)
+				break;
+		}
+		return done;
+	}
+
+	void BinaryFile::pwrite_full(int fd, uint64 offset, const void *src, size_t len)
+	{
+		const char *p = static_cast<const char*>(src);
+		size_t done = 0;
+		while (done < len)
+		{
+			const size_t want = min<size_t>(len - done, 1 << 30);
+#if ZULIB_OS == 0
+			int nbuf = -1;
+			if (_lseeki64(fd, static_cast<__int64>(offset + done), SEEK_SET) >= 0)
+				nbuf = _write(fd, p + done, static_cast<unsigned int>(want));
+#else
+			ssize_t nbuf = ::pwrite(fd, p + done, want, static_cast<off_t>(offset + done));
+			if (nbuf < 0 && errno == EINTR)
+				continue;
+#endif
+			if (nbuf <= 0)
+				throw IOException(TO_STRING("Failed to write file: " << path_));
+			done += static_cast<size_t>(nbuf);
+		}
+	}
+
+	size_t BinaryFile::read_raw(uint64 offset, void *dst, size_t len)
+	{
+		if (cacheMode_ != DIRECT)
+		{
+			const size_t done = pread_full(fd_, offset, dst, len);
+			add_checksum(offset, static_cast<const char*>(dst), done);
+			drop_cache(offset, done, false);
+			return done;
+		}
+
+		const size_t align = DIRECT_ALIGNMENT;
+		char *p = static_cast<char*>(dst);
+		size_t done = 0;
+		while (done < len)
+		{
+			const uint64 off = offset + done;
+			const size_t remain = len - done;
+			if (off % align == 0 && reinterpret_cast<size_t>(p + done) % align == 0 && remain >= align)
+			{
+				const size_t n = remain - remain % align;
+				const size_t got = pread_full(fdDirect_, off, p + done, n);
+				done += got;
+				if (got < n)
+					break;
+				continue;
+			}
+
+			// unaligned head, tail or destination, read whole blocks into the bounce buffer
+			if (bounce_.size() == 0)
+				bounce_.resize(256 * 1024);
+			const uint64 start = off - off % align;
+			const size_t skip = static_cast<size_t>(off - start);
+			const size_t want = min(bounce_.size(), (skip + remain + align - 1) / align * align);
+			const size_t got = pread_full(fdDirect_, start, bounce_.data(), want);
+			if (got <= skip)
+				break;
+			const size_t n = min(got - skip, remain);
+			memcpy(p + done, bounce_.data() + skip, n);
+			done += n;
+			if (got < want)
+				break;
+		}
+		add_checksum(offset, p, done);
+		return done;
+	}
+
+	void BinaryFile::write_raw(uint64 offset, const void *src, size_t len)
+	{
+		if (cacheMode_ != DIRECT)
+		{
+			pwrite_full(fd_, offset, src, len);
+			drop_cache(offset, len, true);
+			return;
+		}
+
+		// whole blocks go direct, the partial blocks at both ends through the cache
+		const size_t align = DIRECT_ALIGNMENT;
+		const char *p = static_cast<const char*>(src);
+		const size_t head = min(len, static_cast<size_t>((align - offset % align) % align));
+		if (head > 0)
+			pwrite_full(fd_, offset, p, head);
+
+		size_t done = head;
+		const size_t body = (len - head) - (len - head) % align;
+		while (done < head + body)
+		{
+			const size_t remain = head + body - done;
+			if (reinterpret_cast<size_t>(p + done) % align == 0)
+			{
+				pwrite_full(fdDirect_, offset + done, p + done, remain);
+				done += remain;
+				break;
+			}
+
+			if (bounce_.size() == 0)
+				bounce_.resize(256 * 1024);
+			const size_t n = min(bounce_.size(), remain);
+			memcpy(bounce_.data(), p + done, n);
+			pwrite_full(fdDirect_, offset + done, bounce_.data(), n);
+			done += n;
+		}
+
+		if (done < len)
+			pwrite_full(fd_, offset + done, p + done, len - done);
+	}
+
+	void BinaryFile::write_buffer(bool all)
+	{
+		if (wlen_ == 0)
+			return;
+
+		size_t n = wlen_;
+		if (!all && cacheMode_ == DIRECT)
+		{
+			// keep the partial last block for the next write, so it goes direct as well
+			const size_t tail = static_cast<size_t>((bufOffset_ + wlen_) % DIRECT_ALIGNMENT);
+			if (tail < wlen_)
+				n = wlen_ - tail;
+		}
+
+		// keep pending data if writing fails, so the caller can retry
+		write_raw(bufOffset_, buf_.data(), n);
+		if (n < wlen_)
+			memmove(buf_.data(), buf_.data() + n, wlen_ - n);
+		bufOffset_ += n;
+		wlen_ -= n;
+	}
+
+	void BinaryFile::flush()
+	{
+		write_buffer(true);
+	}
+
+	size_t BinaryFile::read_bytes(void *dst, size_t len, size_t elemSize)
+	{
+		flush();
+
+		char *p = static_cast<char*>(dst);
+		size_t done = 0;
+		while (done < len)
+		{
+			// serve from buffer first
+			if (pos_ >= bufOffset_ && pos_ < bufOffset_ + rlen_)
+			{
+				const size_t off = static_cast<size_t>(pos_ - bufOffset_);
+				const size_t n = min(rlen_ - off, len - done);
+				memcpy(p + done, buf_.data() + off, n);
+				done += n;
+				pos_ += n;
+				continue;
+			}
+
+			// large reads go straight to the destination
+			if (len - done >= buf_.size())
+			{
+				const size_t n = read_raw(pos_, p + done, len - done);
+				done += n;
+				pos_ += n;
+				break;
+			}
+
+			// direct IO fills the buffer from a block boundary
+			bufOffset_ = cacheMode_ == DIRECT ? pos_ - pos_ % DIRECT_ALIGNMENT : pos_;
+			rlen_ = read_raw(bufOffset_, buf_.data(), buf_.size());
+			if (pos_ >= bufOffset_ + rlen_)
+			{
+				rlen_ = 0;
+				break;
+			}
+		}
+
+		if (need_swap(elemSize))
+			byte_swap(dst, done / elemSize, elemSize);
+		return done;
+	}
+
+	size_t BinaryFile::write_bytes(const void *src, size_t len, size_t elemSize)
+	{
+		if (!(openmode_ & (std::ios_base::out | std::ios_base::app)))
+			throw IOException(TO_STRING("File not opened for writing: " << path_));
+
+		rlen_ = 0;
+		if (wlen_ > 0 && bufOffset_ + wlen_ != pos_)
+			flush();
+
+		const char *p = static_cast<const char*>(src);
+		const bool swap = need_swap(elemSize);
+		if (!swap && len >= buf_.size())
+		{
+			flush();
+			write_raw(pos_, p, len);
+			pos_ += len;
+			bufOffset_ = pos_;
+			return len;
+		}
+
+		size_t done = 0;
+		while (done < len)
+		{
+			if (wlen_ == 0)
+				bufOffset_ = pos_;
+
+			// whole elements only, so they can be swapped in the buffer
+			size_t n = min(buf_.size() - wlen_, len - done);
+			if (swap)
+				n -= n % elemSize;
+			if (n == 0)
+			{
+				write_buffer(false);
+				continue;
+			}
+
+			memcpy(buf_.data() + wlen_, p + done, n);
+			if (swap)
+				byte_swap(buf_.data() + wlen_, n / elemSize, elemSize);
+			wlen_ += n;
+			done += n;
+			pos_ += n;
+			if (wlen_ == buf_.size())
+				write_buffer(false);
+		}
+		return done;
+	}
+
+	size_t BinaryFile::read_bytes_at(uint64 offset, void *dst, size_t len, size_t elemSize)
+	{
+		flush();
+		const size_t done = read_raw(offset, dst, len);
+		if (need_swap(elemSize))
+			byte_swap(dst, done / elemSize, elemSize);
+		return done;
+	}
+
+	size_t BinaryFile::write_bytes_at(uint64 offset, const void *src, size_t len, size_t elemSize)
+	{
+		const uint64 pos = pos_;
+		flush();
+		pos_ = offset;
+		const size_t done = write_bytes(src, len, elemSize);
+		flush();
+		pos_ = pos;
+		return done;
+	}
+
+	size_t BinaryFile::read_all_bytes(AlignedBuffer &buf, size_t elemSize)
+	{
+		flush();
+		const uint64 fileSize = size();
+		if (fileSize > static_cast<uint64>(std::numeric_limits<size_t>::max()))
+			throw RuntimeException(TO_STRING("File too large to read into memory: " << path_));
+
+		buf.resize(static_cast<size_t>(fileSize));
+		const size_t done = fileSize > 0 ? read_raw(0, buf.data(), buf.size()) : 0;
+		buf.resize(done);
+		if (need_swap(elemSize))
+			byte_swap(buf.data(), done / elemSize, elemSize);
+		return done;
+	}
+
+
+
+	void BinaryFile::sync()
+	{
+		flush();
+#if ZULIB_OS == 0
+		const int ret = _commit(fd_);
+#elif defined(__linux__)
+		const int ret = fdatasync(fd_);
+#else
+		const int ret = fsync(fd_);
+#endif
+		if (ret != 0)
+			throw IOException(TO_STRING("Failed to sync file: " << path_));
+		drop_cache(0, 0, true);
+	}
+
+	void BinaryFile::resize(uint64 size)
+	{
+		flush();
+		rlen_ = 0;
+#if ZULIB_OS == 0
+		const int ret = _chsize_s(fd_, static_cast<__int64>(size));
+#else
+		const int ret = ftruncate(fd_, static_cast<off_t>(size));
+#endif
+		if (ret != 0)
+			throw IOException(TO_STRING("Failed to resize file: " << path_));
+	}
+
+	namespace
+	{
+		// | magic | version | record size | committed count | reserved... |
+		const char RECORD_FILE_MAGIC[8] = { 'Z', 'U', 'R', 'E', 'C', 'F', '1', '\0' };
+		const uint64 RECORD_FILE_VERSION = 1;
+		const uint64 RECORD_FILE_HEADER = 64;
+		const uint64 RECORD_FILE_COUNT_OFFSET = 24;
+	}
+
+	std::ios_base::openmode RecordFileBase::prepare(const String &path, int writable)
+	{
+		if (writable <= 0)
+			return std::ios::in;
+
+		if (Path::is_exist(path) < 1)
+		{
+			std::ofstream create(path.c_str(), std::ios::out | std::ios::binary);
+		}
+		return std::ios::in | std::ios::out;
+	}
+
+	RecordFileBase::RecordFileBase(const String &path, size_t recordSize, int writable, size_t commitRecords)
+		: file_(path, prepare(path, writable), 1024 * 1024)
+	{
+		if (recordSize == 0)
+			throw ArgException("Record size must be positive!");
+
+		recordSize_ = recordSize;
+		writable_ = writable > 0;
+		commitRecords_ = max<size_t>(commitRecords, 1);
+		count_ = pending_ = 0;
+
+		const uint64 fileSize = file_.size();
+		if (fileSize == 0 && writable_)
+		{
+			// new file
+			char header[RECORD_FILE_HEADER] = { 0 };
+			const uint64 fields[3] = { RECORD_FILE_VERSION, recordSize, 0 };
+			memcpy(header, RECORD_FILE_MAGIC, sizeof(RECORD_FILE_MAGIC));
+			memcpy(header + sizeof(RECORD_FILE_MAGIC), fields, sizeof(fields));
+			file_.write_at(0, header, sizeof(header));
+			file_.sync();
+			return;
+		}
+
+		char magic[sizeof(RECORD_FILE_MAGIC)];
+		uint64 fields[3];
+		if (fileSize < RECORD_FILE_HEADER || file_.read_at(0, magic, sizeof(magic)) != sizeof(magic)
+			|| file_.read_at(sizeof(magic), fields, 3) != 3 || memcmp(magic, RECORD_FILE_MAGIC, sizeof(magic)) != 0)
+			throw IOException(TO_STRING("Not a record file: " << path));
+		if (fields[0] != RECORD_FILE_VERSION)
+			throw IOException(TO_STRING("Unsupported record file version " << fields[0] << ": " << path));
+		if (fields[1] != recordSize)
+			throw IOException(TO_STRING("Record size mismatch, " << fields[1] << " in file: " << path));
+
+		// records after the committed count may be torn, the count itself may be ahead if the file was cut
+		const uint64 complete = (fileSize - RECORD_FILE_HEADER) / recordSize;
+		count_ = min(fields[2], complete);
+		const uint64 validSize = RECORD_FILE_HEADER + count_ * recordSize;
+		if (writable_ && (count_ != fields[2] || fileSize != validSize))
+		{
+			file_.resize(validSize);
+			file_.write_at(RECORD_FILE_COUNT_OFFSET, &count_, 1);
+			file_.sync();
+		}
+	}
+
+	RecordFileBase::~RecordFileBase()
+	{
+		try
+		{
+			commit();
+		}
+		catch (...)
+		{
+		}
+	}
+
+	void RecordFileBase::read_records(uint64 first, size_t count, void *dst)
+	{
+		if (first > size() || count > size() - first)
+			throw ArgException(TO_STRING("Records [" << first << ", " << first + count << ") out of range " << size()));
+
+		const size_t len = count * recordSize_;
+		if (file_.read_at(RECORD_FILE_HEADER + first * recordSize_, static_cast<char*>(dst), len) != len)
+			throw IOException("Failed to read records.");
+	}
+
+	void RecordFileBase::append_records(const void *src, size_t count)
+	{
+		if (!writable_)
+			throw IOException("Record file not opened for writing.");
+
+		const char *p = static_cast<const char*>(src);
+		while (count > 0)
+		{
+			// never more than commitRecords_ uncommitted
+			const size_t n = static_cast<size_t>(min<uint64>(count, commitRecords_ - pending_));
+			file_.seek(RECORD_FILE_HEADER + size() * recordSize_);
+			file_.write(p, n * recordSize_);
+			pending_ += n;
+			p += n * recordSize_;
+			count -= n;
+			if (pending_ >= commitRecords_)
+				commit();
+		}
+	}
+
+	void RecordFileBase::commit()
+	{
+		if (pending_ == 0)
+			return;
+
+		// data must be durable before the count refers to it
+		file_.sync();
+		const uint64 count = count_ + pending_;
+		file_.write_at(RECORD_FILE_COUNT_OFFSET, &count, 1);
+		file_.sync();
+		count_ = count;
+		pending_ = 0;
+	}
+
+	namespace
+	{
+		// run fn(ctx, i) for i in [0, count) on up to threads threads, the caller included
+		struct ParallelJob
+		{
+			void	(*fn)(void*, size_t);
+			void	*ctx;
+			size_t	count;
+			size_t	next;
+			Mutex	mutex;
+		};
+
+		void parallel_worker(void *arg)
+		{
+			ParallelJob &job = *static_cast<ParallelJob*>(arg);
+			for (;;)
+			{
+				size_t i;
+				{
+					ScopedLock lock(job.mutex);
+					i = job.next++;
+				}
+				if (i >= job.count)
+					return;
+				job.fn(job.ctx, i);
+			}
+		}
+
+		void parallel_run(size_t count, int threads, void(*fn)(void*, size_t), void *ctx)
+		{
+			ParallelJob job;
+			job.fn = fn;
+			job.ctx = ctx;
+			job.count = count;
+			job.next = 0;
+
+			const int extra = static_cast<int>(min<size_t>(count, static_cast<size_t>(max(threads, 1)))) - 1;
+			Thread *workers = extra > 0 ? new Thread[extra] : NULL;
+			for (int i = 0; i < extra; i++)
+			{
+				try
+				{
+					workers[i].start(parallel_worker, &job);
+				}
+				catch (...)
+				{
+					// the threads already running and the caller still do all the work
+					break;
+				}
+			}
+			parallel_worker(&job);
+			// joins only the started threads
+			delete[] workers;
+		}
+
+		const int LZ_HASH_LOG = 14;
+		const size_t LZ_MIN_MATCH = 4;
+		const size_t LZ_LAST_LITERALS = 5;	// block always ends with literals
+		const size_t LZ_MF_LIMIT = 12;		// no match starts in the last bytes
+		const size_t LZ_MAX_OFFSET = 65535;
+
+		inline unsigned int lz_read32(const uchar *p)
+		{
+			unsigned int v;
+			memcpy(&v, p, sizeof(v));
+			return v;
+		}
+
+		inline unsigned int lz_hash(unsigned int v)
+		{
+			return (v * 2654435761U) >> (32 - LZ_HASH_LOG);
+		}
+
+		inline uchar* lz_write_length(uchar *op, size_t len)
+		{
+			for (; len >= 255; len -= 255)
+			{
+				*op++ = 255;
+			}
+			*op++ = static_cast<uchar>(len);
+			return op;
+		}
+	}
+
+	size_t lz_compress(const char *src, size_t len, char *dst, size_t capacity)
+	{
+		const uchar *base = reinterpret_cast<const uchar*>(src);
+		const uchar *ip = base;
+		const uchar *anchor = base;
+		const uchar *end = base + len;
+		uchar *op = reinterpret_cast<uchar*>(dst);
+		uchar *oend = op + capacity;
+
+		if (len >= LZ_MF_LIMIT)
+		{
+			// positions relative to base, only 4GB blocks are addressed
+			unsigned int table[1 << LZ_HASH_LOG];
+			memset(table, 0, sizeof(table));
+			const uchar *mflimit = end - LZ_MF_LIMIT;
+			const uchar *matchlimit = end - LZ_LAST_LITERALS;
+
+			ip++;
+			while (ip < mflimit)
+			{
+				const unsigned int seq = lz_read32(ip);
+				const unsigned int h = lz_hash(seq);
+				const uchar *ref = base + table[h];
+				table[h] = static_cast<unsigned int>(ip - base);
+				if (ref >= ip || static_cast<size_t>(ip - ref) > LZ_MAX_OFFSET || lz_read32(ref) != seq)
+				{
+					// skip faster through incompressible data
+					ip += 1 + ((ip - anchor) >> 6);
+					continue;
+				}
+
+				while (ip > anchor && ref > base && ip[-1] == ref[-1])
+				{
+					ip--;
+					ref--;
+				}
+				const uchar *mp = ip + LZ_MIN_MATCH;
+				const uchar *rp = ref + LZ_MIN_MATCH;
+				while (mp < matchlimit && *mp == *rp)
+				{
+					mp++;
+					rp++;
+				}
+
+				const size_t litLen = ip - anchor;
+				const size_t matchLen = (mp - ip) - LZ_MIN_MATCH;
+				if (static_cast<size_t>(oend - op) < litLen + litLen / 255 + matchLen / 255 + 5)
+					return 0;
+
+				uchar *token = op++;
+				*token = static_cast<uchar>(min<size_t>(litLen, 15) << 4);
+				if (litLen >= 15)
+					op = lz_write_length(op, litLen - 15);
+				memcpy(op, anchor, litLen);
+				op += litLen;
+
+				const size_t offset = ip - ref;
+				*op++ = static_cast<uchar>(offset & 0xff);
+				*op++ = static_cast<uchar>(offset >> 8);
+				*token |= static_cast<uchar>(min<size_t>(matchLen, 15));
+				if (matchLen >= 15)
+					op = lz_write_length(op, matchLen - 15);
+
+				ip = anchor = mp;
+				if (ip < mflimit)
+					table[lz_hash(lz_read32(ip - 2))] = static_cast<unsigned int>(ip - 2 - base);
+			}
+		}
+
+		const size_t litLen = end - anchor;
+		if (static_cast<size_t>(oend - op) < litLen + litLen / 255 + 2)
+			return 0;
+		uchar *token = op++;
+		*token = static_cast<uchar>(min<size_t>(litLen, 15) << 4);
+		if (litLen >= 15)
+			op = lz_write_length(op, litLen - 15);
+		memcpy(op, anchor, litLen);
+		op += litLen;
+		return op - reinterpret_cast<uchar*>(dst);
+	}
+
+	bool lz_decompress(const char *src, size_t len, char *dst, size_t rawLen)
+	{
+		const uchar *ip = reinterpret_cast<const uchar*>(src);
+		const uchar *iend = ip + len;
+		uchar *op = reinterpret_cast<uchar*>(dst);
+		uchar *oend = op + rawLen;
+
+		while (ip < iend)
+		{
+			const unsigned int token = *ip++;
+			size_t litLen = token >> 4;
+			if (litLen == 15)
+			{
+				unsigned int b;
+				do
+				{
+					if (ip >= iend)
+						return false;
+					b = *ip++;
+					litLen += b;
+				} while (b == 255);
+			}
+			if (litLen > static_cast<size_t>(iend - ip) || litLen > static_cast<size_t>(oend - op))
+				return false;
+			memcpy(op, ip, litLen);
+			op += litLen;
+			ip += litLen;
+
+			// last sequence has no match
+			if (ip == iend)
+				break;
+
+			if (iend - ip < 2)
+				return false;
+			const size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+			ip += 2;
+			if (offset == 0 || offset > static_cast<size_t>(op - reinterpret_cast<uchar*>(dst)))
+				return false;
+
+			size_t matchLen = token & 15;
+			if (matchLen == 15)
+			{
+				unsigned int b;
+				do
+				{
+					if (ip >= iend)
+						return false;
+					b = *ip++;
+					matchLen += b;
+				} while (b == 255);
+			}
+			matchLen += LZ_MIN_MATCH;
+			if (matchLen > static_cast<size_t>(oend - op))
+				return false;
+
+			const uchar *match = op - offset;
+			if (offset >= matchLen)
+			{
+				memcpy(op, match, matchLen);
+				op += matchLen;
+			}
+			else
+			{
+				// overlapping copy repeats the pattern
+				for (size_t i = 0; i < matchLen; i++)
+				{
+					*op++ = *match++;
+				}
+			}
+		}
+		return op == oend;
+	}
+
+	namespace
+	{
+		// | magic | block size | blocks... | index: offset, compressed size, raw size, codec... |
+		// | block size | number of blocks | raw size | index offset | magic |
+		const char BLOCK_FILE_MAGIC[8] = { 'Z', 'U', 'B', 'L', 'K', '1', '\0', '\0' };
+		const uint64 BLOCK_FILE_HEADER = 16;
+		const uint64 BLOCK_FILE_FOOTER = 40;
+		enum BLOCK_CODEC { BLOCK_RAW = 0, BLOCK_LZ = 1 };
+
+		struct BlockTask
+		{
+			const char	*src;
+			size_t		srcLen;
+			char		*dst;
+			size_t		dstLen;		// capacity when compressing, raw size when decompressing
+			size_t		outLen;
+			int			codec;
+			bool		ok;
+		};
+
+		void compress_block_task(void *ctx, size_t i)
+		{
+			BlockTask &task = static_cast<BlockTask*>(ctx)[i];
+			task.outLen = lz_compress(task.src, task.srcLen, task.dst, task.dstLen);
+			// incompressible blocks are stored as is
+			task.codec = (task.outLen == 0 || task.outLen >= task.srcLen) ? BLOCK_RAW : BLOCK_LZ;
+		}
+
+		void decompress_block_task(void *ctx, size_t i)
+		{
+			BlockTask &task = static_cast<BlockTask*>(ctx)[i];
+			if (task.codec == BLOCK_RAW)
+			{
+				task.ok = task.srcLen == task.dstLen;
+				if (task.ok)
+					memcpy(task.dst, task.src, task.srcLen);
+			}
+			else
+			{
+				task.ok = task.codec == BLOCK_LZ && lz_decompress(task.src, task.srcLen, task.dst, task.dstLen);
+			}
+		}
+	}
+
+	BlockFileWriter::BlockFileWriter(const String &path, size_t blockSize, int threads)
+		: file_(path, std::ios::out, 4 * 1024 * 1024)
+	{
+		if (blockSize < 1024 || blockSize > (1U << 30))
+			throw ArgException("Block size must be between 1KB and 1GB!");
+
+		blockSize_ = blockSize;
+		threads_ = threads > 0 ? threads : Thread::hardware_concurrency();
+		// two blocks per thread keep all threads busy
+		pending_.resize(blockSize_ * max(threads_, 1) * 2);
+		pendingLen_ = 0;
+		rawSize_ = 0;
+		offset_ = BLOCK_FILE_HEADER;
+		closed_ = false;
+
+		const uint64 size = blockSize_;
+		file_.write(BLOCK_FILE_MAGIC, sizeof(BLOCK_FILE_MAGIC));
+		file_.write(size);
+	}
+
+	BlockFileWriter::~BlockFileWriter()
+	{
+		try
+		{
+			close();
+		}
+		catch (...)
+		{
+		}
+	}
+
+	void BlockFileWriter::write(const void *data, size_t len)
+	{
+		if (closed_)
+			throw RuntimeException("Block file already closed!");
+
+		const char *p = static_cast<const char*>(data);
+		while (len > 0)
+		{
+			const size_t n = min(len, pending_.size() - pendingLen_);
+			memcpy(&pending_.front() + pendingLen_, p, n);
+			pendingLen_ += n;
+			rawSize_ += n;
+			p += n;
+			len -= n;
+			if (pendingLen_ == pending_.size())
+				flush_blocks();
+		}
+	}
+
+	void BlockFileWriter::flush_blocks()
+	{
+		if (pendingLen_ == 0)
+			return;
+
+		const size_t numBlocks = (pendingLen_ + blockSize_ - 1) / blockSize_;
+		const size_t bound = lz_compress_bound(blockSize_);
+		out_.resize(numBlocks * bound);
+		std::vector<BlockTask> tasks(numBlocks);
+		for (size_t i = 0; i < numBlocks; i++)
+		{
+			tasks[i].src = &pending_.front() + i * blockSize_;
+			tasks[i].srcLen = min(blockSize_, pendingLen_ - i * blockSize_);
+			tasks[i].dst = &out_.front() + i * bound;
+			tasks[i].dstLen = bound;
+		}
+		// starting threads costs more than compressing one or two blocks
+		parallel_run(numBlocks, numBlocks > 2 ? threads_ : 1, compress_block_task, &tasks.front());
+
+		for (size_t i = 0; i < numBlocks; i++)
+		{
+			const BlockTask &task = tasks[i];
+			const size_t len = task.codec == BLOCK_LZ ? task.outLen : task.srcLen;
+			file_.write(task.codec == BLOCK_LZ ? task.dst : task.src, len);
+			index_.push_back(offset_);
+			index_.push_back(len);
+			index_.push_back(task.srcLen);
+			index_.push_back(task.codec);
+			offset_ += len;
+		}
+		pendingLen_ = 0;
+	}
+
+	void BlockFileWriter::close()
+	{
+		if (closed_)
+			return;
+
+		flush_blocks();
+		closed_ = true;
+		const uint64 footer[4] = { blockSize_, index_.size() / 4, rawSize_, offset_ };
+		if (!index_.empty())
+			file_.write(&index_.front(), index_.size());
+		file_.write(footer, 4);
+		file_.write(BLOCK_FILE_MAGIC, sizeof(BLOCK_FILE_MAGIC));
+		file_.flush();
+	}
+
+	BlockFileReader::BlockFileReader(const String &path, int threads)
+		: file_(path, std::ios::in, 64 * 1024)
+	{
+		threads_ = threads > 0 ? threads : Thread::hardware_concurrency();
+		cachedBlock_ = std::numeric_limits<size_t>::max();
+
+		const uint64 fileSize = file_.size();
+		char magic[sizeof(BLOCK_FILE_MAGIC)];
+		uint64 footer[4];
+		if (fileSize < BLOCK_FILE_HEADER + BLOCK_FILE_FOOTER
+			|| file_.read_at(fileSize - BLOCK_FILE_FOOTER, footer, 4) != 4
+			|| file_.read_at(fileSize - sizeof(magic), magic, sizeof(magic)) != sizeof(magic)
+			|| memcmp(magic, BLOCK_FILE_MAGIC, sizeof(magic)) != 0
+			|| footer[0] < 1024 || footer[0] > (1U << 30)
+			|| footer[3] < BLOCK_FILE_HEADER || footer[3] > fileSize
+			|| footer[1] != (fileSize - BLOCK_FILE_FOOTER - footer[3]) / 32
+			|| footer[1] * 32 != fileSize - BLOCK_FILE_FOOTER - footer[3])
+			throw IOException(TO_STRING("Not a valid block file: " << path));
+
+		blockSize_ = static_cast<size_t>(footer[0]);
+		rawSize_ = footer[2];
+		index_.resize(static_cast<size_t>(footer[1] * 4));
+		if (!index_.empty() && file_.read_at(footer[3], &index_.front(), index_.size()) != index_.size())
+			throw IOException(TO_STRING("Failed to read block index: " << path));
+
+		// every block but the last one is full, so a block is found by division,
+		// blocks follow each other without gaps, read() relies on it
+		uint64 total = 0;
+		uint64 next = BLOCK_FILE_HEADER;
+		for (size_t i = 0; i < index_.size(); i += 4)
+		{
+			const bool last = (i + 4 == index_.size());
+			if (index_[i] != next || index_[i + 1] > footer[3] || index_[i] > footer[3] - index_[i + 1]
+				|| (!last && index_[i + 2] != blockSize_) || index_[i + 2] > blockSize_)
+				throw IOException(TO_STRING("Corrupted block index: " << path));
+			next = index_[i] + index_[i + 1];
+			total += index_[i + 2];
+		}
+		if (total != rawSize_)
+			throw IOException(TO_STRING("Corrupted block index: " << path));
+	}
+
+	size_t BlockFileReader::read(uint64 offset, void *dst, size_t len)
+	{
+		if (offset >= rawSize_ || len == 0)
+			return 0;
+		len = static_cast<size_t>(min<uint64>(len, rawSize_ - offset));
+
+		char *out = static_cast<char*>(dst);
+		const size_t first = static_cast<size_t>(offset / blockSize_);
+		const size_t last = static_cast<size_t>((offset + len - 1) / blockSize_);
+		if (first == last && first == cachedBlock_)
+		{
+			memcpy(out, &cache_.front() + (offset - static_cast<uint64>(first) * blockSize_), len);
+			return len;
+		}
+
+		// the covered blocks are contiguous in file, read them at once
+		const uint64 begin = index_[first * 4];
+		const uint64 end = index_[last * 4] + index_[last * 4 + 1];
+		comp_.resize(static_cast<size_t>(end - begin));
+		if (!comp_.empty() && file_.read_at(begin, &comp_.front(), comp_.size()) != comp_.size())
+			throw IOException("Failed to read compressed blocks.");
+
+		// whole blocks go straight to dst, partial ones through cache buffers
+		const size_t numBlocks = last - first + 1;
+		std::vector<BlockTask> tasks(numBlocks);
+		std::vector<char> tail;
+		bool headPartial = false;
+		for (size_t i = 0; i < numBlocks; i++)
+		{
+			const size_t b = first + i;
+			const uint64 blockBegin = static_cast<uint64>(b) * blockSize_;
+			const size_t raw = static_cast<size_t>(index_[b * 4 + 2]);
+			BlockTask &task = tasks[i];
+			task.src = comp_.empty() ? NULL : &comp_.front() + (index_[b * 4] - begin);
+			task.srcLen = static_cast<size_t>(index_[b * 4 + 1]);
+			task.dstLen = raw;
+			task.codec = static_cast<int>(index_[b * 4 + 3]);
+			if (blockBegin >= offset && blockBegin + raw <= offset + len)
+			{
+				task.dst = out + (blockBegin - offset);
+			}
+			else if (i == 0)
+			{
+				cache_.resize(blockSize_);
+				task.dst = &cache_.front();
+				headPartial = true;
+			}
+			else
+			{
+				tail.resize(blockSize_);
+				task.dst = &tail.front();
+			}
+		}
+		cachedBlock_ = std::numeric_limits<size_t>::max();
+		// small random reads decompress inline, starting threads would cost more
+		parallel_run(numBlocks, numBlocks > 2 ? threads_ : 1, decompress_block_task, &tasks.front());
+		for (size_t i = 0; i < numBlocks; i++)
+		{
+			if (!tasks[i].ok)
+				throw IOException(TO_STRING("Corrupted block " << first + i));
+		}
+
+		// copy partial blocks
+		const uint64 firstBegin = static_cast<uint64>(first) * blockSize_;
+		if (headPartial)
+		{
+			const size_t skip = static_cast<size_t>(offset - firstBegin);
+			memcpy(out, &cache_.front() + skip, min(len, tasks[0].dstLen - skip));
+			cachedBlock_ = first;
+		}
+		if (!tail.empty())
+		{
+			const uint64 lastBegin = static_cast<uint64>(last) * blockSize_;
+			memcpy(out + (lastBegin - offset), &tail.front(), static_cast<size_t>(offset + len - lastBegin));
+			cache_.swap(tail);
+			cachedBlock_ = last;
+		}
+		return len;
+	}
+
+	GroupCommitWriter::GroupCommitWriter(const String &path, int maxLatencyMs, size_t maxBatch)
+		: path_(path), file_(path, std::ios::out | std::ios::app, 64 * 1024)
+	{
+		maxLatencyMs_ = max(maxLatencyMs, 0);
+		maxBatch_ = max<size_t>(maxBatch, 1);
+		oldest_ = 0;
+		appended_ = durable_ = 0;
+		full_ = forced_ = failed_ = stop_ = false;
+		active_.reserve(maxBatch_);
+		writing_.reserve(maxBatch_);
+		thread_.start(flusher, this);
+	}
+
+	GroupCommitWriter::~GroupCommitWriter()
+	{
+		close();
+	}
+
+	uint64 GroupCommitWriter::append(const void *data, size_t len)
+	{
+		ScopedLock lock(mutex_);
+		// a record larger than the batch limit forms a group by itself
+		while (!active_.empty() && active_.size() + len > maxBatch_ && !failed_ && !stop_)
+		{
+			full_ = true;
+			wake_.notify_one();
+			written_.wait(mutex_);
+		}
+		if (stop_)
+			throw IOException(TO_STRING("Writer is closed: " << path_));
+		if (failed_)
+			throw IOException(TO_STRING("Failed to write file: " << path_));
+
+		if (active_.empty())
+		{
+			oldest_ = Timer::get_real_time();
+			wake_.notify_one();
+		}
+		const char *p = static_cast<const char*>(data);
+		active_.insert(active_.end(), p, p + len);
+		if (active_.size() >= maxBatch_)
+			wake_.notify_one();
+		return ++appended_;
+	}
+
+	void GroupCommitWriter::wait(uint64 ticket)
+	{
+		ScopedLock lock(mutex_);
+		if (ticket > appended_)
+			throw ArgException(TO_STRING("Invalid ticket: " << ticket));
+
+		// nobody benefits from holding back a group someone waits on
+		if (durable_ < ticket && !forced_)
+		{
+			forced_ = true;
+			wake_.notify_one();
+		}
+		while (durable_ < ticket && !failed_)
+		{
+			written_.wait(mutex_);
+		}
+		if (durable_ < ticket)
+			throw IOException(TO_STRING("Failed to write file: " << path_));
+	}
+
+	uint64 GroupCommitWriter::commit(const void *data, size_t len)
+	{
+		const uint64 ticket = append(data, len);
+		wait(ticket);
+		return ticket;
+	}
+
+	void GroupCommitWriter::flush()
+	{
+		uint64 ticket;
+		{
+			ScopedLock lock(mutex_);
+			ticket = appended_;
+		}
+		wait(ticket);
+	}
+
+	bool GroupCommitWriter::is_durable(uint64 ticket)
+	{
+		ScopedLock lock(mutex_);
+		return durable_ >= ticket;
+	}
+
+	void GroupCommitWriter::close()
+	{
+		if (!thread_.joinable())
+			return;
+
+		{
+			ScopedLock lock(mutex_);
+			stop_ = true;
+			wake_.notify_one();
+			written_.notify_all();
+		}
+		thread_.join();
+	}
+
+	void GroupCommitWriter::flusher(void *self)
+	{
+		GroupCommitWriter &w = *static_cast<GroupCommitWriter*>(self);
+
+		w.mutex_.lock();
+		for (;;)
+		{
+			// wait for a group that is full, old enough, forced, or the last one
+			if (w.active_.empty())
+			{
+				w.forced_ = false;
+				if (w.stop_)
+					break;
+				w.wake_.wait(w.mutex_);
+				continue;
+			}
+			if (!w.stop_ && !w.forced_ && !w.full_ && w.active_.size() < w.maxBatch_)
+			{
+				const int remain = w.maxLatencyMs_ - static_cast<int>((Timer::get_real_time() - w.oldest_) * 1000.0);
+				if (remain > 0)
+				{
+					w.wake_.wait(w.mutex_, remain);
+					continue;
+				}
+			}
+
+			// appends continue into the other buffer while this group is written
+			w.active_.swap(w.writing_);
+			w.active_.clear();
+			const uint64 ticket = w.appended_;
+			w.full_ = w.forced_ = false;
+			w.written_.notify_all();
+			w.mutex_.unlock();
+
+			bool ok = true;
+			try
+			{
+				w.file_.write(&w.writing_.front(), w.writing_.size());
+				w.file_.sync();
+			}
+			catch (...)
+			{
+				ok = false;
+			}
+
+			w.mutex_.lock();
+			if (ok)
+				w.durable_ = ticket;
+			else
+				w.failed_ = true;
+			w.written_.notify_all();
+			if (!ok)
+				break;
+		}
+		w.mutex_.unlock();
+	}
+
+	String Path::get_cwd()
+	{
+#ifdef _WIN32
+		char* buffer = NULL;
+		if ((buffer = _getcwd(NULL, 0)) == NULL)
+		{
+			throw IOException("Failed to get current working directory, try use default './' instead");
+			return String("./");
+		}
+		else
+		{
+			String ret(buffer);
+			free(buffer);
+			return reform(ret);
+		}
+#else
+#ifdef _PC_PATH_MAX
+		long size;
+		char *buf = NULL;
+		char *ptr = NULL;
+
+		size = pathconf(".", _PC_PATH_MAX);
+		if ((buf = (char *)malloc((size_t)size)) != NULL)
+		{
+			ptr = getcwd(buf, (size_t)size);
+		}
+
+		if (ptr)
+		{
+			String ret(ptr);
+			free(buf);
+			return ret;
+		}
+		else
+		{
+			throw IOException("Failed to get current working directory, try use default './' instead");
+			return String("./");
+		}
+#else
+		// rarely happens, but in this case you need to preallocate memory 
+		// and increase if buffer is not large enough
+		size_t bufSize = 1024;
+		const size_t maxBufSize = 8192;
+		char* buf = NULL;
+		char* rBuf;
+
+		do 
+		{
+			buf = static_cast<char*>(realloc(buf, bufSize));
+			rBuf = getcwd(buf, bufSize);
+			if (!rBuf) 
+			{
+				if (errno == ERANGE) 
+				{
+					bufSize *= 2;
+					if (bufSize > maxBufSize)
+					{
+						free(buf);
+						break;
+					}
+				} 
+				else 
+				{
+					free(buf);
+					break;
+				}
+			}
+			else
+			{
+				String ret(buf);
+				free(buf);
+				return ret;
+			}
+		} while (!rBuf);
+
+		
+		throw IOException("Failed to get current working directory, try use default './' instead");
+		return String("./");
+
+#endif
+
+#endif
+	}
+
+
+	String Path::get_real_path(String relativePath)
+	{
+#ifdef _WIN32
+		char *buffer = NULL;
+		DWORD siz = MAX_PATH;
+		buffer = (char*)malloc(siz);
+		DWORD retval = GetFullPathNameA(relativePath.c_str(), siz, buffer, 0);
+		if (retval == 0)
+		{
+			throw IOException(TO_STRING("Failed to get realpath with code: " << GetLastError()));
+			return relativePath;
+		}
+		else if (retval > siz)
+		{
+			// need larger buffer
+			free(buffer);
+			siz = retval;
+			buffer = (char*)malloc(siz);
+			if (!buffer)
+			{
+				throw RuntimeException("Failed to allocate memory for path buffer!");
+				return relativePath;
+			}
+
+			retval = GetFullPathNameA(relativePath.c_str(), siz, buffer, 0);
+			if (retval > siz)
+			{
+				// There must be some problem
+				throw RuntimeException("Failed to get realpath, may be too lomg!");
+				return relativePath;
+			}
+		}
+		
+		// now good to return
+		String ret(buffer);
+		free(buffer);
+		ret = reform(ret);
+		return ret;
+#else
+#ifdef PATH_MAX
+		char buffer[PATH_MAX+1];
+		char *realPath = realpath(relativePath.c_str(), buffer);
+		if (realPath)
+		{
+			String ret(realPath);
+			return ret;
+		}
+		else
+		{
+			throw IOException("Failed to get realpath!");
+			return relativePath;
+		}
+#else
+		// try providing NULL buffer with good luck
+		char *realPath = realpath(relativePath.c_str(), NULL);
+		if (realPath)
+		{
+			String ret(realPath);
+			free(realPath);
+			return reform(ret);
+		}
+		else
+		{
+			throw IOException("Failed to get realpath!");
+			return relativePath;
+		}
+#endif
+
+#endif
+	}
+
+
+	int Path::is_exist(String path)
+	{
+#ifdef _WIN32
+		DWORD ret = GetFileAttributesA(path.c_str());
+		if (ret == INVALID_FILE_ATTRIBUTES)
+		{
+			const DWORD err = GetLastError();
+			if (err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND)
+			{
+				return 0;
+			}
+			else
+			{
+				return -1;
+			}
+		}
+
+		return 1;
+#else
+		struct stat sb;
+		if (stat(path.c_str(), &sb) == 0)
+		{
+			return 1;
+		}
+		else
+		{
+			return -1;
+		}
+#endif
+	}
+
+
+	int Path::is_directory(String path)
+	{
+#ifdef _WIN32
+		if (is_exist(path) < 1)
+		{
+			return -1;
+		}
+
+		DWORD ret = GetFileAttributesA(path.c_str());
+		if (ret & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			return 1;
+		}
+		else
+		{
+			return 0;
+		}
+#else
+		struct stat sb;
+		if (stat(path.c_str(), &sb) == 0)
+		{
+			if (S_ISDIR(sb.st_mode))
+			{
+				return 1;
+			}
+
+			if (S_ISREG(sb.st_mode))
+			{
+				return 0;
+			}
+		}
+
+		return -1;
+#endif
+	}
+
+
+
+	String Path::reform(String orig)
+	{
+		std::replace(orig.begin(), orig.end(), '\\', '/');
+
+		size_t pos;
+		while ((pos = orig.find("//")) != String::npos)
+		{
+			orig.erase(orig.begin() + pos);
+		}
+
+		return orig;
+	}
+
+	String Path::get_dir()
+	{
+		String ret = this->path_;
+		const size_t last_slash_idx = ret.find_last_of("\\/");
+		if (std::string::npos != last_slash_idx)
+		{
+			ret.erase(last_slash_idx);
+		}
+		// in case a double slash
+		while (*ret.rbegin() == '\\' || *ret.rbegin() == '/')
+		{
+			ret.erase(ret.length() - 1);
+		}
+
+		return ret;
+	}
+
+
+	String Path::get_basename()
+	{
+		String ret = this->path_;
+		const size_t last_slash_idx = ret.find_last_of("\\/");
+		if (std::string::npos != last_slash_idx)
+		{
+			ret.erase(0, last_slash_idx + 1);
+		}
+
+		// Remove extension if present.
+		const size_t period_idx = ret.rfind('.');
+		if (std::string::npos != period_idx)
+		{
+			ret.erase(period_idx);
+		}
+		return ret;
+	}
+
+
+	String Path::get_extension()
+	{
+		String ret = this->path_;
+		// Remove extension if present.
+		const size_t period_idx = ret.rfind('.');
+		if (std::string::npos != period_idx)
+		{
+			ret.erase(0, period_idx+1);
+		}
+		else
+		{
+			ret = "";
+		}
+		return ret;
+	}
+
+
+	bool Path::wildcard_match(const char *first, const char * second)
+	{
+		return WildcardPattern(first).match(second);
+	}
+
+	namespace
+	{
+		inline char fold_case(char c)
+		{
+			return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+		}
+	}
+
+	WildcardPattern::WildcardPattern(const String &pattern, int caseSensitive)
+		: pattern_(pattern), caseSensitive_(caseSensitive), hasStar_(false), minLength_(0)
+	{
+		// split into head, parts between stars and tail, runs of '*' act as one
+		String part;
+		for (String::const_iterator i = pattern.begin(); i != pattern.end(); i++)
+		{
+			if (*i != '*')
+			{
+				part.push_back(caseSensitive_ > 0 ? *i : fold_case(*i));
+				minLength_++;
+				continue;
+			}
+
+			if (!hasStar_)
+				prefix_.swap(part);
+			else if (!part.empty())
+				middle_.push_back(part);
+			part.clear();
+			hasStar_ = true;
+		}
+
+		if (hasStar_)
+			suffix_.swap(part);
+		else
+			prefix_.swap(part);
+	}
+
+	bool WildcardPattern::equal_at(const String &part, const char *text) const
+	{
+		const size_t n = part.size();
+		if (caseSensitive_ > 0)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				if (part[i] != text[i] && part[i] != '?')
+					return false;
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				if (part[i] != fold_case(text[i]) && part[i] != '?')
+					return false;
+			}
+		}
+		return true;
+	}
+
+	bool WildcardPattern::match(const char *str) const
+	{
+		return match(str, strlen(str));
+	}
+
+	bool WildcardPattern::match(const char *str, size_t len) const
+	{
+		if (!hasStar_)
+			return len == prefix_.size() && equal_at(prefix_, str);
+
+		// cheap rejects first: length, literal head and tail
+		if (len < minLength_ || !equal_at(prefix_, str) || !equal_at(suffix_, str + len - suffix_.size()))
+			return false;
+
+		// Taking the leftmost occurrence of every middle part is always right, as the
+		// star after it can absorb anything a later occurrence would have skipped.
+		const char *pos = str + prefix_.size();
+		const char *end = str + len - suffix_.size();
+		for (std::vector<String>::const_iterator i = middle_.begin(); i != middle_.end(); i++)
+		{
+			const size_t n = i->size();
+			while (pos + n <= end && !equal_at(*i, pos))
+			{
+				pos++;
+			}
+			if (pos + n > end)
+				return false;
+			pos += n;
+		}
+		return true;
+	}
+
+	
+	int Dir::mk_dir(String dir)
+	{
+		Path p(dir);
+		String target = p.str();
+		for (String::iterator i = target.begin(); i != target.end(); i++)
+		{
+			if (*i == '/')
+			{
+				String tmp = target.substr(0, i - target.begin() + 1);
+#ifdef _WIN32
+				CreateDirectoryA(tmp.c_str(), NULL);
+#else
+				mkdir(tmp.c_str(), 0755);
+#endif
+			}
+		}
+
+#ifdef _WIN32
+		if (CreateDirectory(target.c_str(), NULL) ||
+			ERROR_ALREADY_EXISTS == GetLastError())
+		{
+			return 1;
+		}
+
+#else
+		if (mkdir(target.c_str(), 0755) == 0 || errno == EEXIST)
+		{
+			return 1;
+		}
+#endif
+
+		return 0;
+	}
+
+	void Dir::set_root(String path)
+	{
+		path = Path::get_real_path(path);
+
+		if (Path::is_directory(path) < 1)
+		{
+			throw IOException(TO_STRING(path << " is not a valid directory"));
+			String dir = Path(path).get_dir();
+			if (Path::is_directory(dir))
+			{
+				Warning("use parent folder: " << dir << " as root directory instead!");
+			}
+			else
+			{
+				throw RuntimeException(TO_STRING("Failed to solve problem caused by path: " << path));
+			}
+		}
+		
+		if (*path.rbegin() == '/')
+		{
+			root_ = path.substr(0, path.size() - 1);
+		}
+		else
+			root_ = path;
+	}
+
+	namespace
+	{
+		enum ENTRY_KIND
+		{
+			ENTRY_SKIP = 0,
+			ENTRY_FILE,
+			ENTRY_FOLDER
+		};
+
+#ifdef _WIN32
+		// classify a directory entry the way Dir shows it
+		int entry_kind(const WIN32_FIND_DATA &fd, int showHidden)
+		{
+			// skip hidden files if not explicitly enabled
+			if (showHidden <= 0 && (fd.dwFileAttributes & FILE_ATTRIBUTE_HIDDEN))
+				return ENTRY_SKIP;
+
+			// read all (real) files or directories in current folder
+			if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			{
+				// get rid of "." and ".." folders
+				if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0)
+					return ENTRY_SKIP;
+				return ENTRY_FOLDER;
+			}
+			return ENTRY_FILE;
+		}
+#else
+		// classify a directory entry the way Dir shows it, type is the d_type of the entry
+		int entry_kind(const char *name, unsigned char type, int dirFd, int showHidden)
+		{
+			// we always want to skip "." ".."
+			if (!strcmp(name, ".") || !strcmp(name, ".."))
+				return ENTRY_SKIP;
+
+			if (showHidden <= 0 && name[0] == '.')
+			{
+				// skip hidden files/directories
+				return ENTRY_SKIP;
+			}
+
+			if (name[strlen(name)-1] == '~')
+			{
+				// skip backup files end with '~'
+				return ENTRY_SKIP;
+			}
+
+			if (type == DT_UNKNOWN)
+			{
+				// XFS without ftype and many network file systems leave the type out
+				struct stat sb;
+				if (fstatat(dirFd, name, &sb, AT_SYMLINK_NOFOLLOW) != 0)
+					return ENTRY_SKIP;
+				if (S_ISDIR(sb.st_mode))
+					type = DT_DIR;
+				else if (S_ISREG(sb.st_mode))
+					type = DT_REG;
+				else if (S_ISLNK(sb.st_mode))
+					type = DT_LNK;
+			}
+
+			if (type == DT_DIR)
+				return ENTRY_FOLDER;
+			else if (type == DT_REG || type == DT_LNK)
+				return ENTRY_FILE;
+			return ENTRY_SKIP;
+		}
+#endif
+
+		size_t dirBufferSize = 256 * 1024;
+
+#if defined(__linux__) && defined(__NR_getdents64)
+		// record filled by getdents64, glibc does not declare it
+		struct LinuxDirent64
+		{
+			uint64			d_ino;
+			int64			d_off;
+			unsigned short	d_reclen;
+			unsigned char	d_type;
+			char			d_name[1];
+		};
+#endif
+
+		// names of files and subfolders directly in path, filtered the way Dir shows them,
+		// buffer is reused between calls to read directory entries in large batches
+		void read_folder(const String &path, int showHidden, Vecstr &files, Vecstr &folders, std::vector<char> &buffer)
+		{
+#ifdef _WIN32
+			(void)buffer;
+			WIN32_FIND_DATA fd;
+			HANDLE hFind = FindFirstFileA((path + "/*").c_str(), &fd);
+			if (hFind != INVALID_HANDLE_VALUE) 
+			{
+				do {
+					const int kind = entry_kind(fd, showHidden);
+					if (kind == ENTRY_FOLDER)
+						folders.push_back(fd.cFileName);
+					else if (kind == ENTRY_FILE)
+						files.push_back(fd.cFileName);
+				} while (FindNextFileA(hFind, &fd));
+				FindClose(hFind);
+			}
+
+#elif defined(__linux__) && defined(__NR_getdents64)
+			// getdents64 fills a whole buffer per call, readdir asks for 32KB at most
+			const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd < 0)
+				throw IOException(TO_STRING("Cannot open directory: " << path << " to read!"));
+			if (buffer.size() != dirBufferSize)
+				buffer.resize(dirBufferSize);
+
+			for (;;)
+			{
+				const long n = syscall(__NR_getdents64, fd, &buffer[0], buffer.size());
+				if (n == 0)
+					break;
+				if (n < 0)
+				{
+					::close(fd);
+					throw IOException(TO_STRING("Cannot read directory: " << path));
+				}
+
+				for (long pos = 0; pos < n;)
+				{
+					const LinuxDirent64 *entry = reinterpret_cast<const LinuxDirent64*>(&buffer[pos]);
+					pos += entry->d_reclen;
+					const int kind = entry_kind(entry->d_name, entry->d_type, fd, showHidden);
+					if (kind == ENTRY_FOLDER)
+						folders.push_back(String(entry->d_name));
+					else if (kind == ENTRY_FILE)
+						files.push_back(String(entry->d_name));
+				}
+			}
+
+			if (::close(fd) != 0)
+				throw IOException(TO_STRING("Cannot close directory: " << path));
+#else
+			(void)buffer;
+			DIR *dir = opendir(path.c_str());
+			if (dir == NULL)
+			{
+				throw zz::IOException(TO_STRING("Cannot open directory: " << path << " to read!"));
+				return;
+			}
+			struct dirent *entry;
+			while ((entry = readdir(dir)) != NULL)
+			{
+				const int kind = entry_kind(entry->d_name, entry->d_type, dirfd(dir), showHidden);
+				if (kind == ENTRY_FOLDER)
+					folders.push_back(String(entry->d_name));
+				else if (kind == ENTRY_FILE)
+					files.push_back(String(entry->d_name));
+			}
+
+			if (closedir(dir) != 0)
+				throw IOException(TO_STRING("Cannot close directory: " << path));
+#endif
+		}
+
+		struct WalkJob
+		{
+			int threads;
+			int showHidden;
+			int sorted;
+			Dir::WalkCallback callback;
+			void *context;
+			std::vector<std::deque<String> > queues;	// pending folders of each thread
+			Mutex *queueLocks;
+			Mutex lock;		// guards pending, pushed and error
+			CondVar wake;
+			size_t pending;	// folders queued or being read
+			size_t pushed;	// bumped whenever folders are queued, so idle threads never miss them
+			String error;
+			Mutex deliverLock;	// serializes callbacks
+			size_t count;
+			Vecstr all;
+		};
+
+		struct WalkWorker
+		{
+			WalkJob *job;
+			int id;
+		};
+
+		bool take_folder(WalkJob &job, int id, String &folder)
+		{
+			// own deque is used as a stack, keeping the walk depth first
+			{
+				ScopedLock lock(job.queueLocks[id]);
+				std::deque<String> &q = job.queues[id];
+				if (!q.empty())
+				{
+					folder.swap(q.back());
+					q.pop_back();
+					return true;
+				}
+			}
+
+			// steal the oldest folder of another thread, usually the biggest subtree left
+			for (int i = 1; i < job.threads; i++)
+			{
+				const int victim = (id + i) % job.threads;
+				ScopedLock lock(job.queueLocks[victim]);
+				std::deque<String> &q = job.queues[victim];
+				if (!q.empty())
+				{
+					folder.swap(q.front());
+					q.pop_front();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void walk_folder(WalkJob &job, int id, const String &folder, std::vector<char> &buffer)
+		{
+			Vecstr names, folders;
+			String error;
+			try
+			{
+				read_folder(folder, job.showHidden, names, folders, buffer);
+			}
+			catch (Exception &e)
+			{
+				error = e.message();
+				folders.clear();
+			}
+			catch (std::exception &e)
+			{
+				error = e.what();
+				folders.clear();
+			}
+
+			{
+				ScopedLock lock(job.lock);
+				if (!error.empty() && job.error.empty())
+					job.error = error;
+				// stop descending once anything failed
+				if (!job.error.empty())
+					folders.clear();
+				job.pending += folders.size();
+			}
+
+			if (!folders.empty())
+			{
+				{
+					ScopedLock lock(job.queueLocks[id]);
+					for (Vecstr::reverse_iterator i = folders.rbegin(); i != folders.rend(); i++)
+					{
+						job.queues[id].push_back(folder + "/" + *i);
+					}
+				}
+				ScopedLock lock(job.lock);
+				job.pushed++;
+				job.wake.notify_all();
+			}
+
+			if (names.empty())
+				return;
+
+			Vecstr files;
+			files.reserve(names.size());
+			for (Vecstr::iterator i = names.begin(); i != names.end(); i++)
+			{
+				files.push_back(folder + "/" + *i);
+			}
+
+			ScopedLock lock(job.deliverLock);
+			job.count += files.size();
+			if (job.sorted > 0)
+			{
+				job.all.insert(job.all.end(), files.begin(), files.end());
+			}
+			else if (job.callback)
+			{
+				try
+				{
+					job.callback(files, job.context);
+				}
+				catch (Exception &e)
+				{
+					ScopedLock errorLock(job.lock);
+					if (job.error.empty())
+						job.error = e.message();
+				}
+				catch (std::exception &e)
+				{
+					ScopedLock errorLock(job.lock);
+					if (job.error.empty())
+						job.error = e.what();
+				}
+			}
+		}
+
+		void walk_worker(void *arg)
+		{
+			WalkWorker *self = static_cast<WalkWorker*>(arg);
+			WalkJob &job = *self->job;
+			String folder;
+			std::vector<char> buffer;
+			for (;;)
+			{
+				size_t seen;
+				{
+					ScopedLock lock(job.lock);
+					seen = job.pushed;
+				}
+
+				if (take_folder(job, self->id, folder))
+				{
+					walk_folder(job, self->id, folder, buffer);
+					ScopedLock lock(job.lock);
+					if (--job.pending == 0)
+						job.wake.notify_all();
+					continue;
+				}
+
+				// nothing to take: sleep until new folders are queued or the walk is done
+				ScopedLock lock(job.lock);
+				while (job.pending > 0 && job.pushed == seen)
+				{
+					job.wake.wait(job.lock);
+				}
+				if (job.pending == 0)
+					return;
+			}
+		}
+	}
+
+	void Dir::set_read_buffer_size(size_t bytes)
+	{
+		// the largest directory entry needs about 280 bytes
+		dirBufferSize = max<size_t>(bytes, 4096);
+	}
+
+	size_t Dir::read_buffer_size()
+	{
+		return dirBufferSize;
+	}
+
+	size_t Dir::walk_parallel(String root, int threads, WalkCallback callback, void *context, int showHidden, int sorted)
+	{
+		Dir top;
+		top.set_root(root);
+
+		WalkJob job;
+		job.threads = threads > 0 ? threads : Thread::hardware_concurrency();
+		job.showHidden = showHidden;
+		job.sorted = sorted;
+		job.callback = callback;
+		job.context = context;
+		job.queues.resize(job.threads);
+		job.queueLocks = new Mutex[job.threads];
+		job.pending = 1;
+		job.pushed = 0;
+		job.count = 0;
+		job.queues[0].push_back(top.root_);
+
+		// the calling thread is worker 0
+		std::vector<WalkWorker> workers(job.threads);
+		Thread *extra = job.threads > 1 ? new Thread[job.threads - 1] : NULL;
+		for (int i = 0; i < job.threads; i++)
+		{
+			workers[i].job = &job;
+			workers[i].id = i;
+		}
+		for (int i = 1; i < job.threads; i++)
+		{
+			try
+			{
+				extra[i - 1].start(walk_worker, &workers[i]);
+			}
+			catch (...)
+			{
+				// the others steal the work queued for missing threads
+				break;
+			}
+		}
+		walk_worker(&workers[0]);
+		for (int i = 1; i < job.threads; i++)
 		{
-			ret.erase(0, last_slash_idx + 1);
+			extra[i - 1].join();
 		}
+		delete[] extra;
+		delete[] job.queueLocks;
 
-		// Remove extension if present.
-		const size_t period_idx = ret.rfind('.');
-		if (std::string::npos != period_idx)
+		if (!job.error.empty())
+			throw IOException(job.error);
+
+		if (job.sorted > 0 && job.callback && !job.all.empty())
 		{
-			ret.erase(period_idx);
+			std::sort(job.all.begin(), job.all.end());
+			job.callback(job.all, job.context);
 		}
-		return ret;
+		return job.count;
 	}
 
-
-	String Path::get_extension()
+	void Dir::search()
 	{
-		String ret = this->path_;
-		// Remove extension if present.
-		const size_t period_idx = ret.rfind('.');
-		if (std::string::npos != period_idx)
+		// Each folder is scanned exactly once and its subfolders are stored in place,
+		// so no subtree is ever copied. Pointers into childs_ stay valid because a
+		// folder's childs_ is never touched again after it has been scanned.
+		std::vector<Dir*> pending(1, this);
+		std::vector<char> buffer;
+		while (!pending.empty())
 		{
-			ret.erase(0, period_idx+1);
+			Dir *dir = pending.back();
+			pending.pop_back();
+			dir->scan(buffer);
+			for (std::vector<Dir>::reverse_iterator i = dir->childs_.rbegin(); i != dir->childs_.rend(); i++)
+			{
+				pending.push_back(&*i);
+			}
 		}
-		else
+	}
+
+	void Dir::scan(std::vector<char> &buffer)
+	{
+		files_.clear();
+		childs_.clear();
+		Vecstr folders;
+		read_folder(root_, showHidden_, files_, folders, buffer);
+
+		// subfolders are created empty and sized once, so nothing is copied around
+		childs_.resize(folders.size(), Dir());
+		for (size_t i = 0; i < folders.size(); i++)
 		{
-			ret = "";
+			childs_[i].root_ = root_ + "/" + folders[i];
+			childs_[i].recursive_ = recursive_;
+			childs_[i].showHidden_ = showHidden_;
 		}
-		return ret;
 	}
 
 
-	bool Path::wildcard_match(const char *first, const char * second)
+	Vecstr Dir::list_files(int absolutePath)
 	{
-		// If we reach at the end of both strings, we are done
-		if (*first == '\0' && *second == '\0')
-			return true;
+		Vecstr fileList;
+		std::vector<const Dir*> pending(1, this);
+		while (!pending.empty())
+		{
+			const Dir *dir = pending.back();
+			pending.pop_back();
 
-		// Make sure that the characters after '*' are present in second string.
-		// This function assumes that the first string will not contain two
-		// consecutive '*' 
-		if (*first == '*' && *(first + 1) != '\0' && *second == '\0')
-			return false;
+			String prefix;
+			if (absolutePath > 0)
+				prefix = dir->root_ + "/";
+			else if (dir != this)
+				prefix = dir->root_.substr(root_.size() + 1) + "/";
 
-		// If the first string contains '?', or current characters of both 
-		// strings match
-		if (*first == '?' || *first == *second)
-			return wildcard_match(first + 1, second + 1);
+			for (Vecstr::const_iterator i = dir->files_.begin(); i != dir->files_.end(); i++)
+			{
+				fileList.push_back(prefix + *i);
+			}
 
-		// If there is *, then there are two possibilities
-		// a) We consider current character of second string
-		// b) We ignore current character of second string.
-		if (*first == '*')
-			return wildcard_match(first + 1, second) || wildcard_match(first, second + 1);
-		return false;
+			// if resursive flag enabled, subfolders follow in order
+			if (recursive_ <= 0)
+				break;
+			for (std::vector<Dir>::const_reverse_iterator i = dir->childs_.rbegin(); i != dir->childs_.rend(); i++)
+			{
+				pending.push_back(&*i);
+			}
+		}
+		return fileList;
 	}
 
-	
-	int Dir::mk_dir(String dir)
+
+	Vecstr Dir::list_files(Vecstr wildcards, int caseSensitive, int absolutePath)
 	{
-		Path p(dir);
-		String target = p.str();
-		for (String::iterator i = target.begin(); i != target.end(); i++)
+		Vecstr rawList = list_files(absolutePath);
+
+		if (wildcards.size() < 1)
 		{
-			if (*i == '/')
+			// no any filter, just return all file list
+			return rawList;
+		}
+
+		// compile once, each file is listed once even if several patterns match
+		std::vector<WildcardPattern> patterns;
+		for (Vecstr::iterator j = wildcards.begin(); j != wildcards.end(); j++)
+		{
+			patterns.push_back(WildcardPattern(*j, caseSensitive));
+		}
+
+		Vecstr retList;
+		for (Vecstr::iterator i = rawList.begin(); i != rawList.end(); i++)
+		{
+			for (std::vector<WildcardPattern>::iterator j = patterns.begin(); j != patterns.end(); j++)
 			{
-				String tmp = target.substr(0, i - target.begin() + 1);
-#ifdef _WIN32
-				CreateDirectoryA(tmp.c_str(), NULL);
-#else
-				mkdir(tmp.c_str(), 0755);
-#endif
+				if (j->match(*i))
+				{
+					retList.push_back(*i);
+					break;
+				}
 			}
 		}
 
+		return retList;
+	}
+
 #ifdef _WIN32
-		if (CreateDirectory(target.c_str(), NULL) ||
-			ERROR_ALREADY_EXISTS == GetLastError())
+	namespace
+	{
+		struct FindState
 		{
-			return 1;
+			HANDLE				handle;
+			WIN32_FIND_DATA		fd;
+			bool				pending;	// fd holds an entry not returned yet
+		};
+	}
+
+#endif
+	DirIterator::DirIterator(String path, int recurse, int showHidden)
+		: recursive_(recurse), showHidden_(showHidden), isDir_(false), descend_(false)
+	{
+		path = Path::get_real_path(path);
+		if (Path::is_directory(path) < 1)
+			throw IOException(TO_STRING(path << " is not a valid directory"));
+		if (*path.rbegin() == '/')
+			path.erase(path.size() - 1);
+
+		push(path);
+		next();
+	}
+
+	DirIterator::~DirIterator()
+	{
+		while (!stack_.empty())
+		{
+			pop();
 		}
+	}
 
+	void DirIterator::push(const String &folder)
+	{
+		Level level;
+		level.path = folder;
+#ifdef _WIN32
+		FindState *state = new FindState;
+		state->handle = FindFirstFileA((folder + "/*").c_str(), &state->fd);
+		if (state->handle == INVALID_HANDLE_VALUE)
+		{
+			delete state;
+			throw IOException(TO_STRING("Cannot open directory: " << folder << " to read!"));
+		}
+		// the first entry comes with FindFirstFile
+		state->pending = true;
+		level.handle = state;
 #else
-		if (mkdir(target.c_str(), 0755) == 0 || errno == EEXIST)
+		// subfolders are opened relative to the parent, saving the lookup of the whole path
+		const int parent = stack_.empty() ? AT_FDCWD : dirfd(static_cast<DIR*>(stack_.back().handle));
+		const int fd = openat(parent, stack_.empty() ? folder.c_str() : name_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		level.handle = fd < 0 ? NULL : fdopendir(fd);
+		if (level.handle == NULL)
 		{
-			return 1;
+			if (fd >= 0)
+				::close(fd);
+			throw IOException(TO_STRING("Cannot open directory: " << folder << " to read!"));
 		}
 #endif
+		stack_.push_back(level);
+	}
 
-		return 0;
+	void DirIterator::pop()
+	{
+#ifdef _WIN32
+		FindState *state = static_cast<FindState*>(stack_.back().handle);
+		FindClose(state->handle);
+		delete state;
+#else
+		closedir(static_cast<DIR*>(stack_.back().handle));
+#endif
+		stack_.pop_back();
 	}
 
-	void Dir::set_root(String path)
+	bool DirIterator::next()
 	{
-		path = Path::get_real_path(path);
+		// enter the folder returned last time, unless it was skipped
+		if (isDir_ && descend_ && recursive_ > 0)
+		{
+			descend_ = false;
+			push(path_);
+		}
+		isDir_ = false;
+		descend_ = false;
 
-		if (Path::is_directory(path) < 1)
+		while (!stack_.empty())
 		{
-			throw IOException(TO_STRING(path << " is not a valid directory"));
-			String dir = Path(path).get_dir();
-			if (Path::is_directory(dir))
+			Level &top = stack_.back();
+			int kind = ENTRY_SKIP;
+#ifdef _WIN32
+			FindState *state = static_cast<FindState*>(top.handle);
+			if (state->pending || FindNextFileA(state->handle, &state->fd))
 			{
-				Warning("use parent folder: " << dir << " as root directory instead!");
+				state->pending = false;
+				kind = entry_kind(state->fd, showHidden_);
+				if (kind != ENTRY_SKIP)
+					name_ = state->fd.cFileName;
 			}
 			else
 			{
-				throw RuntimeException(TO_STRING("Failed to solve problem caused by path: " << path));
+				pop();
+				continue;
 			}
+#else
+			struct dirent *entry = readdir(static_cast<DIR*>(top.handle));
+			if (entry == NULL)
+			{
+				pop();
+				continue;
+			}
+			kind = entry_kind(entry->d_name, entry->d_type, dirfd(static_cast<DIR*>(top.handle)), showHidden_);
+			if (kind != ENTRY_SKIP)
+				name_ = entry->d_name;
+#endif
+			if (kind == ENTRY_SKIP)
+				continue;
+
+			path_ = top.path + "/" + name_;
+			isDir_ = kind == ENTRY_FOLDER;
+			descend_ = isDir_;
+			return true;
 		}
-		
-		if (*path.rbegin() == '/')
-		{
-			root_ = path.substr(0, path.size() - 1);
-		}
-		else
-			root_ = path;
+
+		name_.clear();
+		path_.clear();
+		return false;
 	}
 
-	void Dir::search()
+	namespace
 	{
-		files_.clear();
-		childs_.clear();
-
-#ifdef _WIN32
-		WIN32_FIND_DATA fd;
-		HANDLE hFind = FindFirstFileA((root_ + "/*").c_str(), &fd);
-		if (hFind != INVALID_HANDLE_VALUE) 
+#if ZULIB_OS == 1
+		// copy [offset, offset + len) to the same offset of the destination
+		void copy_range(int in, int out, uint64 offset, uint64 len, const String &src)
 		{
-			do {
-				// skip hidden files if not explicitly enabled
-				if (showHidden_ <= 0 && (fd.dwFileAttributes & FILE_ATTRIBUTE_HIDDEN))
+			uint64 done = 0;
+#if defined(__linux__) && defined(__NR_copy_file_range)
+			// in kernel copy, NFS and some local file systems even avoid moving the data
+			while (done < len)
+			{
+				int64 inPos = static_cast<int64>(offset + done);
+				int64 outPos = inPos;
+				const long n = syscall(__NR_copy_file_range, in, &inPos, out, &outPos,
+					static_cast<size_t>(min<uint64>(len - done, 1 << 30)), 0);
+				if (n < 0 && errno == EINTR)
 					continue;
-
-				// read all (real) files or directories in current folder
-				if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				// unsupported across file systems or by old kernels, try the next method
+				if (n <= 0)
+					break;
+				done += static_cast<uint64>(n);
+			}
+#endif
+#if defined(__linux__)
+			// sendfile reads at an explicit offset and writes at the file position
+			if (done < len && lseek(out, static_cast<off_t>(offset + done), SEEK_SET) >= 0)
+			{
+				while (done < len)
 				{
-					// get rid of "." and ".." folders
-					if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0)
+					off_t inPos = static_cast<off_t>(offset + done);
+					const ssize_t n = sendfile(out, in, &inPos, static_cast<size_t>(min<uint64>(len - done, 1 << 30)));
+					if (n < 0 && errno == EINTR)
 						continue;
-					else
-					{
-						// subfolder
-						Dir child(root_ + "/" + fd.cFileName, recursive_, showHidden_);
-						childs_.push_back(child);
-					}
+					if (n <= 0)
+						break;
+					done += static_cast<uint64>(n);
 				}
-				else
-					files_.push_back(fd.cFileName);
+			}
+#endif
+			if (done == len)
+				return;
 
-			} while (FindNextFileA(hFind, &fd));
-			FindClose(hFind);
+			std::vector<char> buf(static_cast<size_t>(min<uint64>(len - done, 1 << 20)));
+			while (done < len)
+			{
+				const ssize_t n = ::pread(in, &buf.front(), static_cast<size_t>(min<uint64>(len - done, buf.size())),
+					static_cast<off_t>(offset + done));
+				if (n < 0 && errno == EINTR)
+					continue;
+				if (n < 0)
+					throw IOException(TO_STRING("Failed to read file: " << src));
+				// padding the rest with zeros would look like a good copy
+				if (n == 0)
+					throw IOException(TO_STRING("File shrank while copying: " << src));
+
+				size_t written = 0;
+				while (written < static_cast<size_t>(n))
+				{
+					const ssize_t w = ::pwrite(out, &buf.front() + written, static_cast<size_t>(n) - written,
+						static_cast<off_t>(offset + done + written));
+					if (w < 0 && errno == EINTR)
+						continue;
+					if (w <= 0)
+						throw IOException(TO_STRING("Failed to write copy of file: " << src));
+					written += static_cast<size_t>(w);
+				}
+				done += static_cast<uint64>(n);
+			}
 		}
+#endif
 
-#else
-
-		DIR *dir = opendir(root_.c_str());
-		
-		if (dir == NULL)
+		struct CopyTreeJob
 		{
-			throw zz::IOException(TO_STRING("Cannot open directory: " << root_ << " to read!"));
-			return;
-		}
-		struct dirent *entry;
-		while ((entry = readdir(dir)) != NULL)
+			Vecstr	src;
+			Vecstr	dst;
+			int		reflink;
+			Mutex	mutex;
+			String	error;		// first failure
+		};
+
+		void copy_tree_task(void *arg, size_t i)
 		{
-			if (showHidden_ <= 0 && entry->d_name[0] == '.')
+			CopyTreeJob &job = *static_cast<CopyTreeJob*>(arg);
+			try
 			{
-				// skip hidden files/directories
-				continue;
+				copy_file(job.src[i], job.dst[i], job.reflink);
 			}
-
-			if (entry->d_name[strlen(entry->d_name)-1] == '~')
+			catch (Exception &e)
 			{
-				// skip backup files end with '~'
-				continue;
+				ScopedLock lock(job.mutex);
+				if (job.error.empty())
+					job.error = e.message();
+			}
+			catch (std::exception &e)
+			{
+				ScopedLock lock(job.mutex);
+				if (job.error.empty())
+					job.error = e.what();
 			}
+		}
 
-			if (entry->d_type == DT_DIR)
+		// relative paths of all directories, files and symbolic links under root, without
+		// the display filter of Dir, a copy has to be complete
+		void collect_tree(const String &root, Vecstr &dirs, Vecstr &files, Vecstr &links)
+		{
+			Vecstr pending(1, String());
+			while (!pending.empty())
 			{
-				// we always want to skip "." ".."
-				if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
-				{
-					continue;
-				}
-				else
+				String rel;
+				rel.swap(pending.back());
+				pending.pop_back();
+				const String path = rel.empty() ? root : root + "/" + rel;
+				const String prefix = rel.empty() ? String() : rel + "/";
+#if ZULIB_OS == 0
+				WIN32_FIND_DATA fd;
+				HANDLE hFind = FindFirstFileA((path + "/*").c_str(), &fd);
+				if (hFind == INVALID_HANDLE_VALUE)
+					throw IOException(TO_STRING("Cannot open directory: " << path << " to read!"));
+				do {
+					if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0)
+						continue;
+					if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+					{
+						dirs.push_back(prefix + fd.cFileName);
+						pending.push_back(dirs.back());
+					}
+					else
+						files.push_back(prefix + fd.cFileName);
+				} while (FindNextFileA(hFind, &fd));
+				FindClose(hFind);
+#else
+				DIR *dir = opendir(path.c_str());
+				if (dir == NULL)
+					throw IOException(TO_STRING("Cannot open directory: " << path << " to read!"));
+				struct dirent *entry;
+				while ((entry = readdir(dir)) != NULL)
 				{
-					// subfolder
-					Dir child(root_ + "/" + entry->d_name, recursive_, showHidden_);
-					childs_.push_back(child);
+					if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+						continue;
+
+					unsigned char type = entry->d_type;
+					struct stat sb;
+					if (type == DT_UNKNOWN && fstatat(dirfd(dir), entry->d_name, &sb, AT_SYMLINK_NOFOLLOW) == 0)
+					{
+						if (S_ISDIR(sb.st_mode)) type = DT_DIR;
+						else if (S_ISREG(sb.st_mode)) type = DT_REG;
+						else if (S_ISLNK(sb.st_mode)) type = DT_LNK;
+					}
+
+					if (type == DT_DIR)
+					{
+						dirs.push_back(prefix + entry->d_name);
+						pending.push_back(dirs.back());
+					}
+					else if (type == DT_REG)
+						files.push_back(prefix + entry->d_name);
+					else if (type == DT_LNK)
+						links.push_back(prefix + entry->d_name);
 				}
-			}
-			else if (entry->d_type == DT_REG || entry->d_type == DT_LNK)
-			{
-				files_.push_back(String(entry->d_name));
+				closedir(dir);
+#endif
 			}
 		}
 
-		if (closedir(dir) != 0)
-			throw IOException(TO_STRING("Cannot close directory: " << root_));
+#if ZULIB_OS == 1
+		// recreate a symbolic link with the same target, links to directories included
+		void copy_link(const String &src, const String &dst)
+		{
+			std::vector<char> target(4096);
+			for (;;)
+			{
+				const ssize_t n = readlink(src.c_str(), &target.front(), target.size());
+				if (n < 0)
+					throw IOException(TO_STRING("Failed to read link: " << src));
+				if (static_cast<size_t>(n) < target.size())
+				{
+					target.resize(static_cast<size_t>(n));
+					break;
+				}
+				target.resize(target.size() * 2);
+			}
+			target.push_back('\0');
 
+			::unlink(dst.c_str());
+			if (symlink(&target.front(), dst.c_str()) != 0)
+				throw IOException(TO_STRING("Failed to create link: " << dst));
+		}
 #endif
 	}
 
-
-	Vecstr Dir::list_files(int absolutePath)
+	uint64 copy_file(const String &src, const String &dst, int reflink)
 	{
-		Vecstr fileList;
-		if (absolutePath <= 0)
-			fileList.insert(fileList.end(), files_.begin(), files_.end());
-		else
+#if ZULIB_OS == 0
+		(void)reflink;
+		if (!CopyFileA(src.c_str(), dst.c_str(), FALSE))
+			throw IOException(TO_STRING("Failed to copy file: " << src << " to " << dst));
+
+		struct __stat64 sb;
+		if (_stat64(dst.c_str(), &sb) != 0)
+			throw IOException(TO_STRING("Failed to get size of file: " << dst));
+		return static_cast<uint64>(sb.st_size);
+#else
+		const int in = ::open(src.c_str(), O_RDONLY);
+		struct stat sb;
+		if (in < 0 || fstat(in, &sb) != 0 || !S_ISREG(sb.st_mode))
 		{
-			for (Vecstr::iterator i = files_.begin(); i != files_.end(); i++)
-			{
-				String tmp = root_ + "/" + *i;
-				fileList.push_back(tmp);
-			}
+			if (in >= 0)
+				::close(in);
+			throw IOException(TO_STRING("Failed to open file: " << src));
+		}
+
+		// truncating the destination would destroy the source
+		struct stat db;
+		if (stat(dst.c_str(), &db) == 0 && db.st_dev == sb.st_dev && db.st_ino == sb.st_ino)
+		{
+			::close(in);
+			throw IOException(TO_STRING("Source and destination are the same file: " << src));
+		}
+
+		const int out = ::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, sb.st_mode & 07777);
+		if (out < 0)
+		{
+			::close(in);
+			throw IOException(TO_STRING("Failed to create file: " << dst));
 		}
-		// if resursive flag enabled, asking subfolders to provide their lists
-		if (recursive_)
+
+		const uint64 size = static_cast<uint64>(sb.st_size);
+		try
 		{
-			for (std::vector<Dir>::iterator i = childs_.begin(); i != childs_.end(); i++)
+			bool cloned = false;
+#if defined(__linux__)
+			cloned = reflink > 0 && ioctl(out, FICLONE, in) == 0;
+#else
+			(void)reflink;
+#endif
+			if (!cloned)
 			{
-				Vecstr listFromChild = i->list_files(1);
-				if (absolutePath <= 0)
+				// copy data extents only, holes stay holes
+				uint64 offset = 0;
+				while (offset < size)
 				{
-					for (Vecstr::iterator j = listFromChild.begin(); j != listFromChild.end(); j++)
+					uint64 begin = offset;
+					uint64 end = size;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+					const off_t data = lseek(in, static_cast<off_t>(offset), SEEK_DATA);
+					if (data < 0 && errno == ENXIO)
+						break;
+					if (data >= 0)
 					{
-						String prefix = root_ + "/";
-						Path::remove_substring(prefix, *j);
+						begin = static_cast<uint64>(data);
+						const off_t hole = lseek(in, data, SEEK_HOLE);
+						if (hole > data)
+							end = min(static_cast<uint64>(hole), size);
 					}
+#endif
+					if (begin >= size)
+						break;
+					copy_range(in, out, begin, end - begin, src);
+					offset = end;
 				}
-				fileList.insert(fileList.end(), listFromChild.begin(), listFromChild.end());
+
+				// a trailing hole is only a size
+				if (ftruncate(out, static_cast<off_t>(size)) != 0)
+					throw IOException(TO_STRING("Failed to resize file: " << dst));
 			}
+
+			// mode given to open() is reduced by umask
+			(void)fchmod(out, sb.st_mode & 07777);
+#if defined(__linux__)
+			struct timespec times[2];
+			times[0] = sb.st_atim;
+			times[1] = sb.st_mtim;
+			(void)futimens(out, times);
+#endif
+		}
+		catch (...)
+		{
+			::close(in);
+			::close(out);
+			throw;
 		}
-		return fileList;
-	}
 
+		::close(in);
+		if (::close(out) != 0)
+			throw IOException(TO_STRING("Failed to write copy of file: " << src));
+		return size;
+#endif
+	}
 
-	Vecstr Dir::list_files(Vecstr wildcards, int caseSensitive, int absolutePath)
+	void move_file(const String &src, const String &dst)
 	{
-		Vecstr rawList = list_files(absolutePath);
+#if ZULIB_OS == 0
+		if (!MoveFileExA(src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED))
+			throw IOException(TO_STRING("Failed to move " << src << " to " << dst));
+#else
+		if (::rename(src.c_str(), dst.c_str()) == 0)
+			return;
+		if (errno != EXDEV)
+			throw IOException(TO_STRING("Failed to move " << src << " to " << dst));
+		if (Path::is_directory(src) == 1)
+			throw IOException(TO_STRING("Cannot move directory to another file system: " << src));
+
+		copy_file(src, dst);
+		if (::unlink(src.c_str()) != 0)
+			throw IOException(TO_STRING("Failed to remove moved file: " << src));
+#endif
+	}
 
-		if (wildcards.size() < 1)
+	size_t copy_tree(const String &src, const String &dst, int threads, int reflink)
+	{
+		String from = Path::reform(src);
+		if (from.size() > 1 && *from.rbegin() == '/')
+			from.erase(from.size() - 1);
+		if (Path::is_directory(from) < 1)
+			throw IOException(TO_STRING(src << " is not a valid directory"));
+		Vecstr dirs, files, links;
+		collect_tree(from, dirs, files, links);
+
+		String root = Path::reform(dst);
+		if (!root.empty() && *root.rbegin() == '/')
+			root.erase(root.size() - 1);
+		if (Dir::mk_dir(root) == 0)
+			throw IOException(TO_STRING("Failed to create directory: " << root));
+		for (size_t i = 0; i < dirs.size(); i++)
 		{
-			// no any filter, just return all file list
-			return rawList;
+			if (Dir::mk_dir(root + "/" + dirs[i]) == 0)
+				throw IOException(TO_STRING("Failed to create directory: " << root << "/" << dirs[i]));
 		}
 
-		if (caseSensitive < 1)
+		CopyTreeJob job;
+		job.reflink = reflink;
+		job.src.reserve(files.size());
+		job.dst.reserve(files.size());
+		for (size_t i = 0; i < files.size(); i++)
 		{
-			// not case sensitive
-			for (Vecstr::iterator j = wildcards.begin(); j != wildcards.end(); j++)
-			{
-				std::transform(j->begin(), j->end(), j->begin(), tolower);
-			}
+			job.src.push_back(from + "/" + files[i]);
+			job.dst.push_back(root + "/" + files[i]);
 		}
+		parallel_run(files.size(), threads, copy_tree_task, &job);
 
-		Vecstr retList;
-		for (Vecstr::iterator i = rawList.begin(); i != rawList.end(); i++)
+#if ZULIB_OS == 1
+		for (size_t i = 0; i < links.size(); i++)
 		{
-			for (Vecstr::iterator j = wildcards.begin(); j != wildcards.end(); j++)
+			try
 			{
-				if (Path::wildcard_match(j->c_str(), i->c_str()))
-				{
-					retList.push_back(*i);
-				}
+				copy_link(from + "/" + links[i], root + "/" + links[i]);
+			}
+			catch (Exception &e)
+			{
+				if (job.error.empty())
+					job.error = e.message();
 			}
 		}
+#endif
 
-		return retList;
+		if (!job.error.empty())
+			throw IOException(job.error);
+		return files.size() + links.size();
 	}
 }
\ No newline at end of file
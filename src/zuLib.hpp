@@ -181,16 +181,25 @@ namespace zz
 		explicit Exception(const char* message, const char* prefix = "ZULib Exception : ")
 		{
 			message_ = std::string(prefix) + message;
+			prefixLength_ = message_.size() - std::string(message).size();
 		};
 		explicit Exception(const std::string &message, const char* prefix = "ZULib Exception : ")
 		{
 			message_ = std::string(prefix) + message;
+			prefixLength_ = message_.size() - message.size();
 		};
 		virtual ~Exception() throw() {};
 
 		const char* what() const throw() { return message_.c_str(); };
+
+		/// <summary>
+		/// The message without the exception type prefix, for passing it on in another exception.
+		/// </summary>
+		/// <returns>Message</returns>
+		const char* message() const throw() { return message_.c_str() + prefixLength_; };
 	private:
 		std::string message_;
+		size_t		prefixLength_;
 	};
 
 	/// <summary>
@@ -641,281 +650,1999 @@ namespace zz
 		std::streambuf*   errbuf_;
 	};
 	
-	// --------------------------------- FILE IO -------------------------------//
+	// ---------------------------------- Thread --------------------------------//
 
 	/// <summary>
-	/// Base File Container
+	/// Minimal portable thread running a plain function with one argument.
+	/// Joined automatically on destruction, not copyable.
 	/// </summary>
-	class BaseFile
+	class Thread
 	{
+	public:
+		typedef void(*Func)(void*);
 
-		// FILE_STATUS: | append? | write? | exists? | init? |
-		enum FILE_STATUS { INIT = 0, NEW = 1, READ = 3, WRITE = 5, REWRITE = 7, APPEND = 15, };
+		Thread() : handle_(NULL), func_(NULL), arg_(NULL) {};
+		~Thread() { join(); };
 
-	public:
-		BaseFile(String file, std::ios_base::openmode openmode = std::ios_base::in);
-		virtual ~BaseFile();
+		/// <summary>
+		/// Start running func(arg) in a new thread.
+		/// </summary>
+		/// <param name="func">The function to run.</param>
+		/// <param name="arg">The argument passed to func.</param>
+		void start(Func func, void *arg);
 
-		
 		/// <summary>
-		/// Check file open status
+		/// Wait for the thread to finish, do nothing if not started.
 		/// </summary>
-		/// <returns>true if opened successfully, false otherwise</returns>
-		bool is_open() { return fp_.is_open(); }
+		void join();
 
-	protected:
-		// hide public default constructor
-		BaseFile();
+		/// <summary>
+		/// Check if thread is started and not joined yet
+		/// </summary>
+		/// <returns>true if running</returns>
+		bool joinable() const { return handle_ != NULL; };
+
+		/// <summary>
+		/// Number of logical processors available.
+		/// </summary>
+		/// <returns>Number of processors, at least 1</returns>
+		static int hardware_concurrency();
 
-		std::fstream	fp_;
-		String			path_;
-		int				flag_;
-		std::ios_base::openmode		openmode_;
 	private:
-		void open();
-		//void open(String file, std::ios_base::openmode openmode = std::ios_base::in)
-		//{
-		//	this->openmode_ = openmode;
-		//	this->path_ = file;
-		//	open();
-		//}
-		void close() { fp_.close(); };
+		Thread(const Thread&);
+		Thread& operator=(const Thread&);
+
+		static void run(Thread *self) { self->func_(self->arg_); };
+		friend struct ThreadEntry;
+
+		void*	handle_;	// OS specific thread handle
+		Func	func_;
+		void*	arg_;
 	};
 
 	/// <summary>
-	/// A text only file derived from BaseFile
+	/// Portable mutex, not recursive.
 	/// </summary>
-	class TextFile : public BaseFile
+	class Mutex
 	{
 	public:
-		/// <summary>
-		/// Initializes a new instance of the <see cref="TextFile"/> class.
-		/// </summary>
-		/// <param name="file">The file path.</param>
-		/// <param name="openmode">The openmode.</param>
-		TextFile(String file, std::ios_base::openmode openmode = std::ios_base::in) : BaseFile(file, openmode){};
-		
-		/// <summary>
-		/// Count number of lines in text file. Note that \r(CR) only deprecated(ancient) Mac OS won't be supported.
-		/// </summary>
-		/// <returns>
-		/// Number of Lines
-		/// </returns>
-		int count_lines();
+		Mutex();
+		~Mutex();
+
+		void lock();
+		void unlock();
+
+	private:
+		Mutex(const Mutex&);
+		Mutex& operator=(const Mutex&);
+		friend class CondVar;
+
+		void*	handle_;	// OS specific mutex
+	};
+
+	/// <summary>
+	/// Lock the mutex during the life time of this object.
+	/// </summary>
+	class ScopedLock
+	{
+	public:
+		explicit ScopedLock(Mutex &mutex) : mutex_(mutex) { mutex_.lock(); };
+		~ScopedLock() { mutex_.unlock(); };
+
+	private:
+		ScopedLock(const ScopedLock&);
+		ScopedLock& operator=(const ScopedLock&);
+
+		Mutex	&mutex_;
+	};
+
+	/// <summary>
+	/// Portable condition variable working with Mutex.
+	/// </summary>
+	class CondVar
+	{
+	public:
+		CondVar();
+		~CondVar();
 
 		/// <summary>
-		/// Get next line of opened file
+		/// Unlock the mutex, wait for notification and lock it again. Spurious wakeups may happen.
 		/// </summary>
-		/// <param name="line">The next line.</param>
-		/// <returns>Number of characters in line if success, -1 or 0 if fail</returns>
-		int next_line(String &line);
+		/// <param name="mutex">The locked mutex.</param>
+		void wait(Mutex &mutex);
 
 		/// <summary>
-		/// Goto the specified line at n, if n exceed document length, will goto the last line.
+		/// Same as wait(mutex), but gives up after timeoutMs.
 		/// </summary>
-		/// <param name="n">The n.</param>
-		/// <returns>The line jumped to</returns>
-		int goto_line(int n);
+		/// <param name="mutex">The locked mutex.</param>
+		/// <param name="timeoutMs">The timeout in ms.</param>
+		/// <returns>false if timed out</returns>
+		bool wait(Mutex &mutex, int timeoutMs);
+
+		void notify_one();
+		void notify_all();
+
 	private:
-		// hide public default constructor
-		TextFile();
+		CondVar(const CondVar&);
+		CondVar& operator=(const CondVar&);
+
+		void*	handle_;	// OS specific condition variable
 	};
 
+	// --------------------------------- FILE IO -------------------------------//
+
 	/// <summary>
-	/// A binary only file derived from BaseFile 
+	/// Count '\n' characters in a memory block.
+	/// Uses AVX2 or SSE2 when available(detected at runtime), scalar loop otherwise.
 	/// </summary>
-	class BinaryFile : public BaseFile
+	/// <param name="data">The memory block.</param>
+	/// <param name="len">The length in bytes.</param>
+	/// <returns>Number of newline characters</returns>
+	size_t count_newlines(const char *data, size_t len);
+
+	/// <summary>
+	/// Skip n lines in a memory block, using count_newlines() to jump over whole chunks.
+	/// </summary>
+	/// <param name="data">The memory block.</param>
+	/// <param name="len">The length in bytes.</param>
+	/// <param name="n">Number of newlines to skip.</param>
+	/// <returns>Pointer right after the n-th '\n', NULL if less than n newlines found</returns>
+	const char* skip_newlines(const char *data, size_t len, size_t n);
+
+	/// <summary>
+	/// Reverse byte order of each element in place, vectorized for 2, 4 and 8 byte elements.
+	/// </summary>
+	/// <param name="data">The elements.</param>
+	/// <param name="count">Number of elements.</param>
+	/// <param name="elemSize">Size of each element in bytes.</param>
+	void byte_swap(void *data, size_t count, size_t elemSize);
+
+	/// <summary>
+	/// Check byte order of this machine
+	/// </summary>
+	/// <returns>true if little endian</returns>
+	bool is_little_endian();
+
+	/// <summary>
+	/// CRC-32C(Castagnoli) of a memory block, using the SSE4.2 crc32 instruction on three
+	/// interleaved streams when available, slicing-by-8 tables otherwise.
+	/// </summary>
+	/// <param name="data">The memory block.</param>
+	/// <param name="len">The length in bytes.</param>
+	/// <param name="crc">CRC of preceding data, to checksum data in pieces.</param>
+	/// <returns>The CRC</returns>
+	unsigned int crc32c(const void *data, size_t len, unsigned int crc = 0);
+
+	/// <summary>
+	/// XXH64 hash of a memory block, a fast non-cryptographic 64-bit hash.
+	/// Use Checksum to hash data in pieces.
+	/// </summary>
+	/// <param name="data">The memory block.</param>
+	/// <param name="len">The length in bytes.</param>
+	/// <param name="seed">The seed.</param>
+	/// <returns>The hash</returns>
+	uint64 xxhash64(const void *data, size_t len, uint64 seed = 0);
+
+	/// <summary>
+	/// Incremental CRC32C or XXH64 checksum, the result does not depend on how data is split.
+	/// </summary>
+	class Checksum
 	{
 	public:
+		// supported algorithms
+		enum TYPE { NONE = 0, CRC32C = 1, XXH64 = 2 };
+
+		explicit Checksum(int type = CRC32C, uint64 seed = 0);
+
 		/// <summary>
-		/// Initializes a new instance of the <see cref="BinaryFile"/> class.
+		/// Restart with no data.
 		/// </summary>
-		/// <param name="file">The file path.</param>
-		/// <param name="openmode">The openmode.</param>
-		BinaryFile(String file, std::ios_base::openmode openmode = std::ios::in) : BaseFile(file, openmode | std::ios_base::binary) {};
+		void reset();
+
+		/// <summary>
+		/// Add data.
+		/// </summary>
+		/// <param name="data">The data.</param>
+		/// <param name="len">The length in bytes.</param>
+		void update(const void *data, size_t len);
+
+		/// <summary>
+		/// Checksum of all data added since reset, CRC32C in the low 32 bits.
+		/// </summary>
+		/// <returns>The checksum, 0 for NONE</returns>
+		uint64 value() const;
+
+		int type() const { return type_; };
+		uint64 size() const { return total_; };
+
 	private:
-		// hide public default constructor
-		BinaryFile();
+		int			type_;
+		uint64		seed_;
+		uint64		total_;		// bytes added
+		unsigned int	crc_;
+		uint64		acc_[4];	// XXH64 lane accumulators
+		unsigned char	stripe_[32];	// XXH64 partial stripe
+		size_t		stripeLen_;
 	};
 
-	// ------------------------------- OS DIRECTORY -----------------------------//
+	/// <summary>
+	/// Checksum a whole file in one pass, reading 4MB blocks in a read-ahead thread so
+	/// IO overlaps with hashing. Throws IOException if the file can not be read.
+	/// </summary>
+	/// <param name="path">The file path.</param>
+	/// <param name="type">One of the Checksum::TYPE values.</param>
+	/// <returns>The checksum</returns>
+	uint64 hash_file(const String &path, int type = Checksum::XXH64);
 
 	/// <summary>
-	/// Basic file or directory path container
+	/// Heap buffer aligned to a power of 2 boundary(page by default), suitable for direct IO and SIMD.
 	/// </summary>
-	class Path
+	class AlignedBuffer
 	{
 	public:
+		AlignedBuffer() : data_(NULL), size_(0), capacity_(0), alignment_(4096) {};
+		explicit AlignedBuffer(size_t size, size_t alignment = 4096);
+		~AlignedBuffer() { release(); };
+
 		/// <summary>
-		/// Initializes a new instance of the <see cref="Path"/> class.
+		/// Change size, existing content is kept. Memory only grows until release().
 		/// </summary>
-		/// <param name="path">The path.</param>
-		Path(String path) { this->path_ = reform(path); };
+		/// <param name="size">The size in bytes.</param>
+		void resize(size_t size);
 
 		/// <summary>
-		/// Return absolute path of the specified reletive path.
+		/// Free the memory.
 		/// </summary>
-		/// <param name="reletivePath">The reletive path.</param>
-		/// <returns>The absolute path.</returns>
-		static String get_real_path(String reletivePath);
+		void release();
+
+		char* data() { return data_; };
+		const char* data() const { return data_; };
+		size_t size() const { return size_; };
+		size_t alignment() const { return alignment_; };
 
 		/// <summary>
-		/// Get current working directory.
+		/// View buffer as array of T
 		/// </summary>
-		/// <returns>Current working directory.</returns>
-		static String get_cwd();
+		/// <returns>Pointer to first element</returns>
+		template<typename T> T* as() { return reinterpret_cast<T*>(data_); };
+		template<typename T> const T* as() const { return reinterpret_cast<const T*>(data_); };
+
+	private:
+		AlignedBuffer(const AlignedBuffer&);
+		AlignedBuffer& operator=(const AlignedBuffer&);
+
+		char	*data_;
+		size_t	size_;
+		size_t	capacity_;
+		size_t	alignment_;
+	};
+
+	/// <summary>
+	/// Shared memory mapping of a whole regular file, read-only by default.
+	/// Pipes and special files are refused so the caller can fall back to stream IO.
+	/// </summary>
+	class FileMap
+	{
+	public:
+		// access pattern hints, see advise()
+		enum ADVICE { NORMAL = 0, SEQUENTIAL = 1, RANDOM = 2, WILLNEED = 3, HUGEPAGE = 4 };
+
+		FileMap() : addr_(NULL), size_(0), mapped_(false), writable_(false) {};
+		~FileMap() { unmap(); };
 
 		/// <summary>
-		/// Remove substrings from the specified string.
+		/// Map the specified file. An empty regular file is mapped with size 0.
 		/// </summary>
-		/// <param name="substring">The substring.</param>
-		/// <param name="toTrim">To string to trim from.</param>
-		inline static void remove_substring(const String & substring, String &toTrim)
-		{
-			String::size_type i = toTrim.find(substring);
-			if (i != String::npos)
-			{
-				toTrim.erase(i, substring.length());
-			}
-		}
+		/// <param name="path">The file path.</param>
+		/// <param name="writable">Map read-write(1), changes go to the file, or read-only(0).</param>
+		/// <param name="advice">Access pattern hint applied from the start, see advise(). On Windows
+		/// SEQUENTIAL and RANDOM can only be given here, as flags of the file handle.</param>
+		/// <returns>true if mapped, false if the file can not be mapped</returns>
+		bool map(const String &path, int writable = 0, int advice = NORMAL);
 
 		/// <summary>
-		/// Check if the specified path is a valid directory.
+		/// Release the mapping if any.
 		/// </summary>
-		/// <param name="path">The path.</param>
-		/// <returns>1 if directory, 0 if file, -1 otherwise</returns>
-		static int is_directory(String path);
+		void unmap();
 
 		/// <summary>
-		/// Check if the specified path exists.
+		/// Give the kernel a hint about the access pattern, ignored where unsupported.
 		/// </summary>
-		/// <param name="path">The path.</param>
-		/// <returns>1 if exist, 0 if not exist, -1 for other possible situations</returns>
-		static int is_exist(String path);
+		/// <param name="advice">One of the ADVICE values.</param>
+		void advise(int advice);
 
 		/// <summary>
-		/// Convert backslashes to trailing slashes if any and remove duplicate slashes
+		/// Load all pages now instead of faulting them in on first access.
 		/// </summary>
-		/// <param name="orig">The original path.</param>
-		/// <returns>Reformed path.</returns>
-		static String reform(String orig);
+		void prefault();
 
 		/// <summary>
-		/// Check if is directory, member function
+		/// Write modified pages of a writable mapping back to the file.
 		/// </summary>
-		/// <returns>1 if directory, 0 if file, -1 otherwise</returns>
-		int dir() { return is_directory(this->path_); };
+		/// <returns>true if succeeded</returns>
+		bool sync();
+
+		bool is_mapped() const { return mapped_; };
+		bool is_writable() const { return writable_; };
+		const char* data() const { return static_cast<const char*>(addr_); };
+		char* data() { return static_cast<char*>(addr_); };
+		size_t size() const { return size_; };
+
+	private:
+		// not copyable
+		FileMap(const FileMap&);
+		FileMap& operator=(const FileMap&);
+
+		void*	addr_;
+		size_t	size_;
+		bool	mapped_;
+		bool	writable_;
+	};
+
+	/// <summary>
+	/// Memory mapped file viewed as an array of T, for random access to large
+	/// fixed-layout files without reading them. Trailing bytes of a partial element are ignored.
+	/// <code>
+	/// MappedArray&lt;float&gt; features("features.bin");
+	/// features.advise(FileMap::RANDOM);
+	/// float x = features[i * dim + j];
+	/// </code>
+	/// </summary>
+	template<typename T> class MappedArray
+	{
+	public:
+		MappedArray() {};
 
 		/// <summary>
-		/// Check if path exists.
+		/// Initializes a new instance of the <see cref="MappedArray"/> class, throws if mapping failed.
 		/// </summary>
-		/// <returns>1 if exist, 0 if not exist, -1 for other possible situations</returns>
-		int exist() { return is_exist(this->path_); };
+		/// <param name="path">The file path.</param>
+		/// <param name="writable">Map read-write(1) or read-only(0).</param>
+		explicit MappedArray(const String &path, int writable = 0)
+		{
+			if (!open(path, writable))
+				throw IOException(TO_STRING("Failed to map file: " << path));
+		}
 
 		/// <summary>
-		/// Prune directory of full path
+		/// Map the specified file, previous mapping is released.
 		/// </summary>
-		/// <returns>Directory</returns>
-		String get_dir();
+		/// <param name="path">The file path.</param>
+		/// <param name="writable">Map read-write(1) or read-only(0).</param>
+		/// <returns>true if mapped</returns>
+		bool open(const String &path, int writable = 0) { return map_.map(path, writable); };
+
+		void close() { map_.unmap(); };
+		bool is_open() const { return map_.is_mapped(); };
+		bool is_writable() const { return map_.is_writable(); };
 
 		/// <summary>
-		/// Prune pure filename without extension
+		/// Access hint, see FileMap::ADVICE.
 		/// </summary>
-		/// <returns>Pure filename</returns>
-		String get_basename();
+		/// <param name="advice">One of FileMap::ADVICE values.</param>
+		void advise(int advice) { map_.advise(advice); };
 
 		/// <summary>
-		/// Get extension
+		/// Load all pages now, see FileMap::prefault().
 		/// </summary>
-		/// <returns>Extension or empty string(if no extension)</returns>
-		String get_extension();
+		void prefault() { map_.prefault(); };
 
 		/// <summary>
-		/// Get full path
+		/// Write changes back to the file, see FileMap::sync().
 		/// </summary>
-		/// <returns>Full path</returns>
-		String str() { return this->path_; };
+		/// <returns>true if succeeded</returns>
+		bool sync() { return map_.sync(); };
+
+		size_t size() const { return map_.size() / sizeof(T); };
+		bool empty() const { return size() == 0; };
+		T* data() { return reinterpret_cast<T*>(map_.data()); };
+		const T* data() const { return reinterpret_cast<const T*>(map_.data()); };
+		T* begin() { return data(); };
+		T* end() { return data() + size(); };
+		const T* begin() const { return data(); };
+		const T* end() const { return data() + size(); };
 
 		/// <summary>
-		/// Set path.
+		/// Unchecked element access. Writing to a read-only mapping crashes.
 		/// </summary>
-		/// <param name="path">The new path.</param>
-		void set_path(String path) { path_ = reform(path); };
+		/// <param name="i">The index.</param>
+		/// <returns>Reference to element</returns>
+		T& operator[](size_t i) { return data()[i]; };
+		const T& operator[](size_t i) const { return data()[i]; };
 
 		/// <summary>
-		/// Match wildcards
+		/// Bounds checked element access, throws ArgException if out of range.
 		/// </summary>
-		/// <param name="first">The wildcard char string.</param>
-		/// <param name="second">The string to match.</param>
-		/// <returns>True if matches, false otherwise.</returns>
-		static bool wildcard_match(const char *first, const char *second);
+		/// <param name="i">The index.</param>
+		/// <returns>Reference to element</returns>
+		T& at(size_t i)
+		{
+			check_index(i);
+			return data()[i];
+		}
+
+		const T& at(size_t i) const
+		{
+			check_index(i);
+			return data()[i];
+		}
 
 	private:
+		MappedArray(const MappedArray&);
+		MappedArray& operator=(const MappedArray&);
 
-		String path_;
+		void check_index(size_t i) const
+		{
+			if (i >= size())
+				throw ArgException(TO_STRING("Index " << i << " out of range " << size()));
+		}
+
+		FileMap	map_;
 	};
 
 	/// <summary>
-	/// OS directory list handler class
+	/// Sequential writer producing a file through a shared writable mapping, data is stored
+	/// with plain memory copies instead of write calls. The file grows in large steps,
+	/// preallocated with fallocate where supported so a full disk is reported as IOException
+	/// instead of a crash, and the mapping is extended with mremap on Linux.
+	/// close() truncates the file to the length written.
+	/// <code>
+	/// MappedWriter out("result.bin");
+	/// out.write(header);
+	/// char *p = out.reserve(4096);
+	/// generate(p, 4096);
+	/// out.commit(4096);
+	/// </code>
 	/// </summary>
-	class Dir
+	class MappedWriter
 	{
 	public:
 		/// <summary>
-		/// Initializes a new instance of the <see cref="Dir"/> class.
+		/// Initializes a new instance of the <see cref="MappedWriter"/> class, the file is
+		/// created or truncated. Throws IOException on failure.
 		/// </summary>
-		/// <param name="path">The path.</param>
-		/// <param name="recurse">Recursive?</param>
-		/// <param name="showHidden">Show hidden files/directories?</param>
-		Dir(String path, int recurse = 0, int showHidden = 0) { search(path, recurse, showHidden); };
+		/// <param name="path">The file path.</param>
+		/// <param name="growStep">Size in bytes the file grows by when full.</param>
+		MappedWriter(const String &path, size_t growStep = 64 * 1024 * 1024);
+		~MappedWriter();
 
 		/// <summary>
-		/// Create the specified directory.
-		/// Will automatically create intermediate directories if necessary.
+		/// Append data.
 		/// </summary>
-		/// <param name="dir">The dir.</param>
-		/// <returns></returns>
-		static int mk_dir(String dir);
+		/// <param name="data">The data.</param>
+		/// <param name="len">The length in bytes.</param>
+		void write(const void *data, size_t len);
 
 		/// <summary>
-		/// Search recursively?
+		/// Append one element in native byte order.
 		/// </summary>
-		/// <returns>1 if true, 0 otherwise</returns>
-		int is_recursive() { return recursive_; };
+		/// <param name="value">The value.</param>
+		template<typename T> void write(const T &value) { write(&value, sizeof(T)); };
 
 		/// <summary>
-		/// Is hidden file/directory shown?
+		/// Get space to generate data in place, growing the file if needed.
+		/// Valid until the next reserve(), write() or close().
 		/// </summary>
-		/// <returns>1 if true, 0 otherwise</returns>
-		int is_show_hidden() { return showHidden_; };
+		/// <param name="len">Number of bytes needed.</param>
+		/// <returns>Pointer to the end of written data</returns>
+		char* reserve(size_t len);
 
 		/// <summary>
-		/// Set recursion mode
+		/// Append len bytes generated in the space returned by reserve().
 		/// </summary>
-		/// <param name="r">Use recursion(1) or not(0).</param>
-		void set_recursive(int recursive) { recursive_ = recursive; };
+		/// <param name="len">Number of bytes, at most the reserved length.</param>
+		void commit(size_t len);
 
 		/// <summary>
-		/// Set whether to show hidden files/directories.
+		/// Write data back to the file and wait until it is on the storage device.
 		/// </summary>
-		/// <param name="s">Show hidden(1) or not(0).</param>
-		void set_show_hidden(int showHidden) { showHidden_ = showHidden; };
+		void sync();
 
 		/// <summary>
-		/// Return root path of this directory
+		/// Unmap and truncate the file to the written length. Called by destructor.
 		/// </summary>
-		/// <returns>Root path</returns>
-		String str() { return root_; };
+		void close();
 
-		/// <summary>
-		/// List files
-		/// </summary>
-		/// <param name="abosolute">Use absolute path or not.</param>
-		/// <returns>Vector of filenames in String.</returns>
-		Vecstr list_files(int absolutePath = 0);
+		bool is_open() const { return addr_ != NULL; };
+		uint64 size() const { return size_; };
+		uint64 capacity() const { return capacity_; };
 
-		/// <summary>
-		/// List files given the specified wildcards to match.
+	private:
+		MappedWriter(const MappedWriter&);
+		MappedWriter& operator=(const MappedWriter&);
+
+		// extend file and mapping to hold at least need bytes
+		void grow(uint64 need);
+		void map_view(size_t len);
+
+		String		path_;
+		int			fd_;
+		char		*addr_;
+		uint64		size_;		// bytes written
+		uint64		capacity_;	// mapped length
+		size_t		growStep_;
+		size_t		reserved_;	// length of last reserve()
+	};
+
+	/// <summary>
+	/// Streaming decompressor pulling compressed blocks from an input stream.
+	/// The codec is chosen from the magic bytes, gzip(including concatenated members)
+	/// and zlib streams are supported if zlib is found at build time(ZULIB_HAVE_ZLIB).
+	/// </summary>
+	class Decompressor
+	{
+	public:
+		// known codecs, see detect()
+		enum CODEC { NONE = 0, GZIP = 1, ZLIB = 2, BZIP2 = 3, XZ = 4, ZSTD = 5 };
+
+		Decompressor();
+		~Decompressor() { close(); };
+
+		/// <summary>
+		/// Detect codec from the first bytes of a stream.
+		/// </summary>
+		/// <param name="magic">The first bytes.</param>
+		/// <param name="len">Number of bytes available, 10 bytes are enough.</param>
+		/// <returns>One of the CODEC values, NONE if not compressed</returns>
+		static int detect(const char *magic, size_t len);
+
+		/// <summary>
+		/// Detect codec of a regular file. Pipes and special files are never probed.
+		/// </summary>
+		/// <param name="path">The file path.</param>
+		/// <returns>One of the CODEC values, NONE if not compressed</returns>
+		static int detect(const String &path);
+
+		/// <summary>
+		/// Check if the codec can be decoded by this build
+		/// </summary>
+		/// <param name="codec">One of the CODEC values.</param>
+		/// <returns>true if supported</returns>
+		static bool is_supported(int codec);
+
+		/// <summary>
+		/// Start decoding from the current position of source. Throws if codec not supported.
+		/// </summary>
+		/// <param name="source">The compressed input, must outlive the decompressor.</param>
+		/// <param name="codec">One of the CODEC values except NONE.</param>
+		/// <param name="blockSize">Size of compressed blocks read from source.</param>
+		void open(std::istream *source, int codec, size_t blockSize = 1024 * 1024);
+
+		/// <summary>
+		/// Release the codec state.
+		/// </summary>
+		void close();
+
+		bool is_open() const { return stream_ != NULL; };
+		int codec() const { return codec_; };
+
+		/// <summary>
+		/// Decompress up to len bytes to dst. Throws on corrupted or truncated input.
+		/// </summary>
+		/// <param name="dst">The destination.</param>
+		/// <param name="len">The maximum length.</param>
+		/// <returns>Number of bytes decompressed, less than len only at end of stream</returns>
+		size_t read(char *dst, size_t len);
+
+		/// <summary>
+		/// Decompress and drop n bytes.
+		/// </summary>
+		/// <param name="n">Number of bytes to skip.</param>
+		/// <returns>Number of bytes skipped</returns>
+		uint64 skip(uint64 n);
+
+	private:
+		Decompressor(const Decompressor&);
+		Decompressor& operator=(const Decompressor&);
+
+		std::istream	*source_;
+		std::vector<char>	in_;	// compressed block
+		void		*stream_;	// codec state
+		int			codec_;
+		bool		end_;		// end of stream reached
+		bool		memberEnd_;	// a gzip member finished, another one may follow
+	};
+
+	/// <summary>
+	/// Background reader filling a bounded ring of large blocks ahead of the consumer,
+	/// so that IO overlaps with computation. Blocks are read with pread where available.
+	/// </summary>
+	class ReadAhead
+	{
+	public:
+		ReadAhead();
+		~ReadAhead() { stop(); };
+
+		/// <summary>
+		/// Start reading the file from offset in a worker thread. Stops previous reading if any.
+		/// </summary>
+		/// <param name="path">The file path.</param>
+		/// <param name="offset">The start offset.</param>
+		/// <param name="blockSize">Size of each block in bytes.</param>
+		/// <param name="depth">Number of blocks in the ring, at least 2.</param>
+		/// <param name="codec">Decompress in the worker thread, offset is then in decompressed bytes.</param>
+		/// <returns>true if started, false if the file is not a regular file</returns>
+		bool start(const String &path, uint64 offset, size_t blockSize = 4 * 1024 * 1024, int depth = 4,
+			int codec = Decompressor::NONE);
+
+		/// <summary>
+		/// Stop the worker thread and release the file.
+		/// </summary>
+		void stop();
+
+		bool is_running() const { return thread_.joinable(); };
+
+		/// <summary>
+		/// Get unread data of the current block, waiting for the worker if necessary.
+		/// </summary>
+		/// <param name="len">Number of bytes available.</param>
+		/// <returns>Pointer to data, NULL if end of file</returns>
+		const char* acquire(size_t &len);
+
+		/// <summary>
+		/// Mark len bytes returned by acquire() as consumed.
+		/// </summary>
+		/// <param name="len">Number of bytes consumed.</param>
+		void release(size_t len);
+
+		/// <summary>
+		/// Copy up to len bytes to dst.
+		/// </summary>
+		/// <param name="dst">The destination.</param>
+		/// <param name="len">The maximum length.</param>
+		/// <returns>Number of bytes copied, 0 if end of file</returns>
+		size_t read(char *dst, size_t len);
+
+	private:
+		ReadAhead(const ReadAhead&);
+		ReadAhead& operator=(const ReadAhead&);
+
+		static void worker(void *self);
+
+		std::vector<std::vector<char> >	ring_;
+		std::vector<size_t>	lens_;		// valid bytes in each block
+		size_t		head_;		// next block to consume
+		size_t		tail_;		// next block to fill
+		size_t		count_;		// number of filled blocks
+		size_t		consumed_;	// bytes consumed in head block
+		uint64		offset_;	// next file offset to read
+		int			codec_;		// Decompressor::NONE if reading raw bytes
+		bool		done_;		// worker reached end of file
+		bool		failed_;	// worker failed to read
+		bool		stop_;		// worker asked to stop
+		int			fd_;
+		String		path_;
+		Mutex		mutex_;
+		CondVar		filled_;
+		CondVar		freed_;
+		Thread		thread_;
+	};
+
+	/// <summary>
+	/// Non-owning view of one line inside the read buffer of a TextFile.
+	/// Only valid until the next read or goto_line() call on the same file.
+	/// </summary>
+	struct LineRef
+	{
+		const char	*data;		//!< line content, '\n' excluded, not null terminated
+		size_t		size;		//!< number of characters
+		uint64		lineNo;		//!< line number, starting from 1
+		uint64		offset;		//!< byte offset of line in file
+
+		LineRef() : data(NULL), size(0), lineNo(0), offset(0) {};
+
+		/// <summary>
+		/// Copy to String
+		/// </summary>
+		/// <returns>The line</returns>
+		String str() const { return String(data, size); };
+	};
+
+	/// <summary>
+	/// A batch of lines stored back to back in one arena, each followed by '\0'.
+	/// Owned by the caller and reused across TextFile::next_lines() calls,
+	/// so the arena and offsets only reallocate while growing to the largest batch.
+	/// </summary>
+	class LineBatch
+	{
+	public:
+		LineBatch() : offsets_(1, 0), firstLine_(0), firstOffset_(0) {};
+
+		/// <summary>
+		/// Number of lines in batch
+		/// </summary>
+		/// <returns>Number of lines</returns>
+		size_t size() const { return offsets_.size() - 1; };
+
+		bool empty() const { return offsets_.size() == 1; };
+
+		/// <summary>
+		/// Get the i-th line, null terminated
+		/// </summary>
+		/// <param name="i">The index.</param>
+		/// <returns>Pointer to line</returns>
+		const char* line(size_t i) const { return &arena_[offsets_[i]]; };
+
+		/// <summary>
+		/// Length of the i-th line, terminator excluded
+		/// </summary>
+		/// <param name="i">The index.</param>
+		/// <returns>Number of characters</returns>
+		size_t line_size(size_t i) const { return offsets_[i + 1] - offsets_[i] - 1; };
+
+		/// <summary>
+		/// Line number of the first line in batch, starting from 1
+		/// </summary>
+		/// <returns>Line number</returns>
+		uint64 first_line() const { return firstLine_; };
+
+		/// <summary>
+		/// Byte offset of the first line in file
+		/// </summary>
+		/// <returns>File offset</returns>
+		uint64 first_offset() const { return firstOffset_; };
+
+		/// <summary>
+		/// Raw arena holding all lines, see offsets()
+		/// </summary>
+		/// <returns>The arena</returns>
+		const std::vector<char>& arena() const { return arena_; };
+
+		/// <summary>
+		/// Start of each line in arena, size() + 1 entries, last one is the end of arena
+		/// </summary>
+		/// <returns>The offsets</returns>
+		const std::vector<size_t>& offsets() const { return offsets_; };
+
+		/// <summary>
+		/// Remove all lines, keep allocated memory
+		/// </summary>
+		void clear() { arena_.clear(); offsets_.resize(1); };
+
+		/// <summary>
+		/// Append a copy of the line to the batch
+		/// </summary>
+		/// <param name="line">The line.</param>
+		void append(const LineRef &line)
+		{
+			if (empty())
+			{
+				firstLine_ = line.lineNo;
+				firstOffset_ = line.offset;
+			}
+			arena_.insert(arena_.end(), line.data, line.data + line.size);
+			arena_.push_back('\0');
+			offsets_.push_back(arena_.size());
+		};
+
+	private:
+		std::vector<char>	arena_;
+		std::vector<size_t>	offsets_;
+		uint64		firstLine_;
+		uint64		firstOffset_;
+	};
+
+	/// <summary>
+	/// Base File Container
+	/// </summary>
+	class BaseFile
+	{
+
+		// FILE_STATUS: | append? | write? | exists? | init? |
+		enum FILE_STATUS { INIT = 0, NEW = 1, READ = 3, WRITE = 5, REWRITE = 7, APPEND = 15, };
+
+	public:
+		BaseFile(String file, std::ios_base::openmode openmode = std::ios_base::in);
+		virtual ~BaseFile();
+
+		
+		/// <summary>
+		/// Check file open status
+		/// </summary>
+		/// <returns>true if opened successfully, false otherwise</returns>
+		bool is_open() { return fp_.is_open(); }
+
+		/// <summary>
+		/// Get codec of a transparently decompressed file
+		/// </summary>
+		/// <returns>One of Decompressor::CODEC, Decompressor::NONE if read as is</returns>
+		int codec() const { return codec_; };
+
+		/// <summary>
+		/// Checksum data while it is read from the file, call before reading.
+		/// </summary>
+		/// <param name="type">One of the Checksum::TYPE values, NONE to disable.</param>
+		void enable_checksum(int type = Checksum::CRC32C) { checksum_ = Checksum(type); };
+
+		/// <summary>
+		/// Checksum of the file data read so far, counted from offset 0. Equals the checksum of
+		/// the whole file once it has been read to the end. Data read again is not added twice,
+		/// reading past a skipped range stops the checksum at the gap, see checksum_size().
+		/// Covers decompressed data of compressed files.
+		/// </summary>
+		/// <returns>The checksum, see Checksum::value()</returns>
+		uint64 checksum() { hash_pending(); return checksum_.value(); };
+
+		/// <summary>
+		/// Number of bytes covered by checksum()
+		/// </summary>
+		/// <returns>Size in bytes</returns>
+		uint64 checksum_size() { hash_pending(); return checksum_.size(); };
+
+	protected:
+		// hide public default constructor
+		BaseFile();
+
+		std::fstream	fp_;
+		String			path_;
+		int				flag_;
+		std::ios_base::openmode		openmode_;
+		int				codec_;		// Decompressor::NONE if not compressed
+		Decompressor	decoder_;
+		Checksum		checksum_;	// type NONE if disabled
+
+		void open();
+		// detect compressed input and decode it from now on, throws if codec not supported
+		void enable_decompression();
+		// read decompressed data if compressed, raw data otherwise
+		size_t read_stream(char *dst, size_t len);
+		// seek to offset, in decompressed bytes if compressed
+		void seek_stream(uint64 offset);
+		// add data read at offset to the checksum where it extends the checksummed range
+		void add_checksum(uint64 offset, const char *data, size_t len);
+		// add data consumed without a read call, from a mapping
+		virtual void hash_pending() {};
+		//void open(String file, std::ios_base::openmode openmode = std::ios_base::in)
+		//{
+		//	this->openmode_ = openmode;
+		//	this->path_ = file;
+		//	open();
+		//}
+		void close() { fp_.close(); };
+	};
+
+	/// <summary>
+	/// A text only file derived from BaseFile.
+	/// Compressed input(gzip, zlib) is detected from magic bytes and decompressed on the fly.
+	/// </summary>
+	class TextFile : public BaseFile
+	{
+	public:
+		/// <summary>
+		/// Initializes a new instance of the <see cref="TextFile"/> class.
+		/// </summary>
+		/// <param name="file">The file path.</param>
+		/// <param name="openmode">The openmode.</param>
+		/// <param name="mapped">Serve reads from a memory mapping(1) or stream(0).
+		/// Ignored for writable files, compressed files, pipes and special files.</param>
+		TextFile(String file, std::ios_base::openmode openmode = std::ios_base::in, int mapped = 0);
+		~TextFile();
+
+		/// <summary>
+		/// Check if reads are served from a memory mapping
+		/// </summary>
+		/// <returns>1 if mapped, 0 otherwise</returns>
+		int is_mapped() { return map_.is_mapped() ? 1 : 0; };
+
+		/// <summary>
+		/// Count number of lines in text file. Note that \r(CR) only deprecated(ancient) Mac OS won't be supported.
+		/// </summary>
+		/// <returns>
+		/// Number of Lines
+		/// </returns>
+		int count_lines();
+
+		/// <summary>
+		/// Count number of lines using multiple threads, each thread scans one byte range of the file.
+		/// Same result as count_lines(), falls back to it for pipes, special files and compressed files.
+		/// </summary>
+		/// <param name="threads">Number of threads, use all processors if &lt;= 0.</param>
+		/// <returns>
+		/// Number of Lines
+		/// </returns>
+		int count_lines(int threads);
+
+		/// <summary>
+		/// Get next line of opened file
+		/// </summary>
+		/// <param name="line">The next line.</param>
+		/// <returns>Number of characters in line if success, -1 or 0 if fail</returns>
+		int next_line(String &line);
+
+		/// <summary>
+		/// Get next line of opened file without copy, empty lines are distinguished from end of file.
+		/// The line points into an internal buffer reused by the next call.
+		/// </summary>
+		/// <param name="line">The line view.</param>
+		/// <returns>1 if a line is read(may be empty), 0 if end of file, -1 if fail</returns>
+		int next_line(LineRef &line);
+
+		/// <summary>
+		/// Read up to maxLines lines into the batch, replacing its previous content.
+		/// </summary>
+		/// <param name="maxLines">Maximum number of lines to read.</param>
+		/// <param name="batch">The batch to fill.</param>
+		/// <returns>Number of lines read, 0 if end of file</returns>
+		size_t next_lines(size_t maxLines, LineBatch &batch);
+
+		/// <summary>
+		/// Follow a growing file like 'tail -F': return the next complete line,
+		/// waiting for new data if end of file is reached.
+		/// Truncated files are read again from the beginning, and a rotated file (renamed or
+		/// deleted and recreated) is reopened after the remaining lines of the old one are read.
+		/// Waits on inotify events on Linux, sleeps between checks otherwise.
+		/// Compressed files are not followed, 0 is returned right at end of file.
+		/// </summary>
+		/// <param name="line">The line view.</param>
+		/// <param name="timeoutMs">Maximum time to wait in ms, wait forever if &lt; 0.</param>
+		/// <returns>1 if a line is read, 0 if timed out, -1 if fail</returns>
+		int follow_line(LineRef &line, int timeoutMs = -1);
+
+		/// <summary>
+		/// Enable or disable read-ahead: a background thread reads the next blocks while
+		/// lines of the current one are processed. Used by next_line(), goto_line() and count_lines().
+		/// No effect in mapped mode, disabled by follow_line().
+		/// </summary>
+		/// <param name="enable">Enable(1) or disable(0).</param>
+		/// <param name="depth">Number of blocks read ahead.</param>
+		/// <param name="blockSize">Size of each block in bytes.</param>
+		/// <returns>1 if read-ahead is enabled, 0 otherwise</returns>
+		int prefetch(int enable, int depth = 4, size_t blockSize = 4 * 1024 * 1024);
+
+		/// <summary>
+		/// Goto the specified line at n, if n exceed document length, will goto the last line.
+		/// Rewinds even if end of file was reached before.
+		/// </summary>
+		/// <param name="n">The n.</param>
+		/// <returns>The line jumped to</returns>
+		int goto_line(int n);
+
+		/// <summary>
+		/// Build a sparse line index holding the byte offset of every interval-th line,
+		/// so goto_line() scans at most interval lines. 
+		/// The index is saved to a sidecar file(path + ".lidx") for later load_index() calls,
+		/// except for compressed files.
+		/// </summary>
+		/// <param name="interval">Number of lines between two index entries.</param>
+		/// <param name="save">Save sidecar file(1) or not(0).</param>
+		/// <returns>Number of lines, same as count_lines()</returns>
+		int build_index(int interval = 1024, int save = 1);
+
+		/// <summary>
+		/// Load line index from sidecar file, rejected if size or modification time of file changed.
+		/// </summary>
+		/// <returns>1 if loaded, 0 otherwise</returns>
+		int load_index();
+
+		/// <summary>
+		/// Check if a line index is available for goto_line()
+		/// </summary>
+		/// <returns>1 if indexed, 0 otherwise</returns>
+		int is_indexed() { return lineIndex_.empty() ? 0 : 1; };
+
+	private:
+		// hide public default constructor
+		TextFile();
+
+		// restart reading at byte offset
+		void reset_reader(uint64 offset);
+		// read more data into buffer, keep unread bytes
+		bool fill_buffer();
+		// skip n lines, return number of lines skipped
+		uint64 skip_lines(uint64 n);
+		// get next line, unterminated last line only returned if partial is true
+		int read_line(LineRef &line, bool partial);
+		// check for truncation or rotation, return 1 if line holds the rest of a rotated file,
+		// -1 if reading restarted, 0 if unchanged
+		int check_follow(LineRef &line);
+		// block until file changes or timeout, return false on timeout
+		bool wait_follow(int timeoutMs);
+		// checksum the mapping up to the current position
+		void hash_pending();
+
+		FileMap		map_;
+		std::vector<char>	rbuf_;	// reusable read buffer in stream mode
+		const char	*rdata_;	// rbuf_ or the mapping
+		size_t		rbegin_;	// first unread byte in rdata_
+		size_t		rend_;		// end of valid bytes in rdata_
+		uint64		roffset_;	// file offset of rdata_[0]
+		bool		rEof_;		// no more data to fill
+		bool		eof_;		// mimic eof state of std::getline
+		uint64		lineNo_;	// number of next line
+
+		ReadAhead	readAhead_;
+		int			prefetchDepth_;	// 0 if read-ahead disabled
+		size_t		prefetchBlock_;
+
+		int			notifyFd_;	// inotify instance in follow mode, -1 if unused
+		int			fileWatch_;	// inotify watch of the followed file
+		uint64		fileId_;	// inode or file index of the followed file, to detect rotation
+
+		std::vector<uint64>	lineIndex_;		// byte offset of line (i * indexInterval_ + 1)
+		int			indexInterval_;
+	};
+
+	/// <summary>
+	/// Delimited text(CSV, TSV...) reader on top of TextFile.
+	/// Fields of each record are kept as offsets into the line buffer, nothing is copied
+	/// unless a quoted field spans multiple lines. Numbers are only parsed when requested.
+	/// <code>
+	/// TextFile tf("data.tsv");
+	/// DelimitedReader reader(tf, '\t');
+	/// while (reader.next_record() > 0)
+	/// {
+	///     double v;
+	///     if (reader.to_double(2, v)) sum += v;
+	/// }
+	/// </code>
+	/// </summary>
+	class DelimitedReader
+	{
+	public:
+		/// <summary>
+		/// Initializes a new instance of the <see cref="DelimitedReader"/> class.
+		/// </summary>
+		/// <param name="file">The opened text file, must outlive the reader.</param>
+		/// <param name="delimiter">The field delimiter.</param>
+		/// <param name="quote">The quote character, '\0' to disable quoting.</param>
+		DelimitedReader(TextFile &file, char delimiter = ',', char quote = '"');
+
+		/// <summary>
+		/// Read and split next record.
+		/// </summary>
+		/// <returns>1 if a record is read, 0 if end of file, -1 if fail</returns>
+		int next_record();
+
+		/// <summary>
+		/// Number of fields in current record
+		/// </summary>
+		/// <returns>Number of fields</returns>
+		size_t size() const { return bounds_.size() / 2; };
+
+		/// <summary>
+		/// Raw content of the i-th field without surrounding quotes, not null terminated.
+		/// Escaped quotes are still doubled, see is_escaped().
+		/// </summary>
+		/// <param name="i">The field index.</param>
+		/// <returns>Pointer to field</returns>
+		const char* field(size_t i) const { return data_ + bounds_[2 * i]; };
+
+		/// <summary>
+		/// Length of the raw content of the i-th field
+		/// </summary>
+		/// <param name="i">The field index.</param>
+		/// <returns>Number of characters</returns>
+		size_t field_size(size_t i) const { return bounds_[2 * i + 1] - bounds_[2 * i]; };
+
+		/// <summary>
+		/// Check if the i-th field contains doubled quotes
+		/// </summary>
+		/// <param name="i">The field index.</param>
+		/// <returns>true if escaped quotes inside</returns>
+		bool is_escaped(size_t i) const { return escaped_[i] != 0; };
+
+		/// <summary>
+		/// Copy the i-th field with escaped quotes resolved
+		/// </summary>
+		/// <param name="i">The field index.</param>
+		/// <returns>The field</returns>
+		String str(size_t i) const;
+
+		/// <summary>
+		/// Parse the i-th field as integer, surrounding spaces allowed.
+		/// </summary>
+		/// <param name="i">The field index.</param>
+		/// <param name="value">The value.</param>
+		/// <returns>true if the whole field is a valid integer</returns>
+		bool to_int(size_t i, int64 &value) const;
+
+		/// <summary>
+		/// Parse the i-th field as floating point number, surrounding spaces allowed.
+		/// </summary>
+		/// <param name="i">The field index.</param>
+		/// <param name="value">The value.</param>
+		/// <returns>true if the whole field is a valid number</returns>
+		bool to_double(size_t i, double &value) const;
+
+		/// <summary>
+		/// Line number where current record starts
+		/// </summary>
+		/// <returns>Line number</returns>
+		uint64 line_number() const { return lineNo_; };
+
+	private:
+		DelimitedReader(const DelimitedReader&);
+		DelimitedReader& operator=(const DelimitedReader&);
+
+		// split data_, return false if a quoted field is not closed
+		bool split();
+
+		TextFile	&file_;
+		char		delimiter_;
+		char		quote_;
+		const char	*data_;		// current record
+		size_t		size_;
+		uint64		lineNo_;
+		String		record_;	// only used for records spanning lines
+		std::vector<size_t>	bounds_;	// begin and end of each field in data_
+		std::vector<char>	escaped_;	// field contains doubled quotes
+	};
+
+	/// <summary>
+	/// One read request of AsyncReader, owned by the caller until completed.
+	/// </summary>
+	struct AsyncRead
+	{
+		uint64	offset;		//!< file offset
+		void	*data;		//!< destination of at least size bytes
+		size_t	size;		//!< number of bytes to read
+		size_t	bytes;		//!< bytes read when completed, less than size only at end of file
+		int		error;		//!< 0 if succeeded, system error code otherwise
+		void	*user;		//!< caller data, untouched
+
+		AsyncRead() : offset(0), data(NULL), size(0), bytes(0), error(0), user(NULL) {};
+		AsyncRead(uint64 off, void *dst, size_t len, void *userData = NULL)
+			: offset(off), data(dst), size(len), bytes(0), error(0), user(userData) {};
+	};
+
+	/// <summary>
+	/// Batched asynchronous positional reads keeping up to depth requests in flight.
+	/// Uses io_uring on Linux when the kernel supports it, a pool of pread workers otherwise.
+	/// Not thread safe, one thread submits and reaps.
+	/// <code>
+	/// AsyncReader reader;
+	/// reader.open("data.bin", 128);
+	/// reader.submit(&requests.front(), requests.size());
+	/// std::vector&lt;AsyncRead*&gt; done(64);
+	/// while (reader.pending() > 0)
+	/// {
+	///     size_t n = reader.wait(&done.front(), done.size());
+	///     ...
+	/// }
+	/// </code>
+	/// </summary>
+	class AsyncReader
+	{
+	public:
+		AsyncReader() : impl_(NULL) {};
+		~AsyncReader() { close(); };
+
+		/// <summary>
+		/// Open file for asynchronous reads, previous file is closed.
+		/// </summary>
+		/// <param name="path">The file path.</param>
+		/// <param name="depth">Maximum number of reads in flight.</param>
+		/// <param name="useUring">Try io_uring(1) or always use the worker pool(0).</param>
+		/// <returns>true if opened</returns>
+		bool open(const String &path, int depth = 64, int useUring = 1);
+
+		/// <summary>
+		/// Wait for all pending reads and close the file.
+		/// </summary>
+		void close();
+
+		bool is_open() const { return impl_ != NULL; };
+
+		/// <summary>
+		/// Check if reads go through io_uring
+		/// </summary>
+		/// <returns>true if io_uring, false if worker pool</returns>
+		bool is_uring() const;
+
+		/// <summary>
+		/// Queue requests, they are started as soon as queue depth allows.
+		/// </summary>
+		/// <param name="reads">The requests, must stay valid until completed.</param>
+		/// <param name="count">Number of requests.</param>
+		/// <returns>Number of requests queued</returns>
+		size_t submit(AsyncRead *reads, size_t count);
+
+		/// <summary>
+		/// Collect completed requests without blocking.
+		/// </summary>
+		/// <param name="done">Receives pointers to completed requests.</param>
+		/// <param name="max">Capacity of done.</param>
+		/// <returns>Number of completed requests</returns>
+		size_t poll(AsyncRead **done, size_t max);
+
+		/// <summary>
+		/// Collect completed requests, blocking until at least one completes.
+		/// </summary>
+		/// <param name="done">Receives pointers to completed requests.</param>
+		/// <param name="max">Capacity of done.</param>
+		/// <param name="timeoutMs">Maximum time to wait in ms, wait forever if &lt; 0.</param>
+		/// <returns>Number of completed requests, 0 if timed out or nothing pending</returns>
+		size_t wait(AsyncRead **done, size_t max, int timeoutMs = -1);
+
+		/// <summary>
+		/// Number of submitted requests not collected yet
+		/// </summary>
+		/// <returns>Number of requests</returns>
+		size_t pending() const;
+
+	private:
+		AsyncReader(const AsyncReader&);
+		AsyncReader& operator=(const AsyncReader&);
+
+		void	*impl_;		// io_uring or worker pool state
+	};
+
+	/// <summary>
+	/// A binary only file derived from BaseFile.
+	/// Typed reads and writes go through a large internal buffer on the file descriptor,
+	/// elements are byte swapped on the fly if the file endianness differs from the machine.
+	/// <code>
+	/// BinaryFile bf("matrix.bin", std::ios::out);
+	/// bf.set_endian(BinaryFile::BIG);
+	/// bf.write(values, count);
+	/// </code>
+	/// </summary>
+	class BinaryFile : public BaseFile
+	{
+	public:
+		// byte order of data in file
+		enum ENDIAN { NATIVE = 0, LITTLE = 1, BIG = 2 };
+		// page cache usage, see set_cache_mode()
+		enum CACHE { CACHED = 0, DIRECT = 1, STREAMING = 2 };
+		// offset, length and memory alignment of direct IO
+		static const size_t DIRECT_ALIGNMENT = 4096;
+
+		/// <summary>
+		/// Initializes a new instance of the <see cref="BinaryFile"/> class.
+		/// In append mode the position starts at end of file.
+		/// </summary>
+		/// <param name="file">The file path.</param>
+		/// <param name="openmode">The openmode.</param>
+		/// <param name="bufferSize">Size of the internal buffer in bytes.</param>
+		/// <param name="cacheMode">One of the CACHE values, see set_cache_mode().</param>
+		BinaryFile(String file, std::ios_base::openmode openmode = std::ios::in, size_t bufferSize = 4 * 1024 * 1024,
+			int cacheMode = CACHED);
+		~BinaryFile();
+
+		/// <summary>
+		/// Choose how IO uses the page cache, so one-pass scans do not evict other data.
+		/// DIRECT bypasses the cache with O_DIRECT, unaligned heads and tails are handled
+		/// internally. STREAMING reads and writes through the cache and drops the pages
+		/// once done with posix_fadvise(DONTNEED). DIRECT falls back to STREAMING where
+		/// the file system does not support it.
+		/// </summary>
+		/// <param name="mode">One of the CACHE values.</param>
+		/// <returns>The mode in effect</returns>
+		int set_cache_mode(int mode);
+		int cache_mode() const { return cacheMode_; };
+
+		/// <summary>
+		/// Set byte order of data in file, NATIVE by default.
+		/// </summary>
+		/// <param name="endian">One of the ENDIAN values.</param>
+		void set_endian(int endian);
+		int endian() const { return endian_; };
+
+		/// <summary>
+		/// Read count elements at current position.
+		/// </summary>
+		/// <param name="dst">The destination.</param>
+		/// <param name="count">Number of elements.</param>
+		/// <returns>Number of complete elements read, less than count at end of file</returns>
+		template<typename T> size_t read(T *dst, size_t count)
+		{
+			return read_bytes(dst, count * sizeof(T), sizeof(T)) / sizeof(T);
+		}
+
+		/// <summary>
+		/// Read one element at current position.
+		/// </summary>
+		/// <param name="value">The value.</param>
+		/// <returns>true if read, false at end of file</returns>
+		template<typename T> bool read(T &value)
+		{
+			return read(&value, 1) == 1;
+		}
+
+		/// <summary>
+		/// Write count elements at current position.
+		/// </summary>
+		/// <param name="src">The elements.</param>
+		/// <param name="count">Number of elements.</param>
+		/// <returns>Number of elements written</returns>
+		template<typename T> size_t write(const T *src, size_t count)
+		{
+			return write_bytes(src, count * sizeof(T), sizeof(T)) / sizeof(T);
+		}
+
+		/// <summary>
+		/// Write one element at current position.
+		/// </summary>
+		/// <param name="value">The value.</param>
+		/// <returns>true if written</returns>
+		template<typename T> bool write(const T &value)
+		{
+			return write(&value, 1) == 1;
+		}
+
+		/// <summary>
+		/// Read count elements at byte offset, current position unchanged.
+		/// </summary>
+		/// <param name="offset">The byte offset.</param>
+		/// <param name="dst">The destination.</param>
+		/// <param name="count">Number of elements.</param>
+		/// <returns>Number of complete elements read</returns>
+		template<typename T> size_t read_at(uint64 offset, T *dst, size_t count)
+		{
+			return read_bytes_at(offset, dst, count * sizeof(T), sizeof(T)) / sizeof(T);
+		}
+
+		/// <summary>
+		/// Write count elements at byte offset, current position unchanged.
+		/// </summary>
+		/// <param name="offset">The byte offset.</param>
+		/// <param name="src">The elements.</param>
+		/// <param name="count">Number of elements.</param>
+		/// <returns>Number of elements written</returns>
+		template<typename T> size_t write_at(uint64 offset, const T *src, size_t count)
+		{
+			return write_bytes_at(offset, src, count * sizeof(T), sizeof(T)) / sizeof(T);
+		}
+
+		/// <summary>
+		/// Read the whole file into buffer with one allocation sized by fstat, bypassing
+		/// the internal buffer. Current position unchanged.
+		/// </summary>
+		/// <param name="buf">The buffer, resized to the file size.</param>
+		/// <returns>Number of complete elements read</returns>
+		template<typename T> size_t read_all(AlignedBuffer &buf)
+		{
+			return read_all_bytes(buf, sizeof(T)) / sizeof(T);
+		}
+
+		/// <summary>
+		/// Read the whole file into buffer as raw bytes.
+		/// </summary>
+		/// <param name="buf">The buffer, resized to the file size.</param>
+		/// <returns>Number of bytes read</returns>
+		size_t read_all(AlignedBuffer &buf) { return read_all_bytes(buf, 1); };
+
+		/// <summary>
+		/// Map the file as an array of T after writing buffered data, see MappedArray.
+		/// Writable mapping requires the file opened for writing.
+		/// </summary>
+		/// <param name="array">The array view.</param>
+		/// <param name="writable">Map read-write(1) or read-only(0).</param>
+		/// <returns>true if mapped</returns>
+		template<typename T> bool map(MappedArray<T> &array, int writable = 0)
+		{
+			flush();
+			if (writable > 0 && !(openmode_ & (std::ios_base::out | std::ios_base::app)))
+				return false;
+			return array.open(path_, writable);
+		}
+
+		/// <summary>
+		/// Open an asynchronous reader on this file after writing buffered data.
+		/// Requests complete with raw bytes, endianness is not applied.
+		/// </summary>
+		/// <param name="reader">The reader.</param>
+		/// <param name="depth">Maximum number of reads in flight.</param>
+		/// <returns>true if opened</returns>
+		bool open_async(AsyncReader &reader, int depth = 64)
+		{
+			flush();
+			return reader.open(path_, depth);
+		}
+
+		/// <summary>
+		/// Move current position
+		/// </summary>
+		/// <param name="offset">The byte offset.</param>
+		void seek(uint64 offset) { pos_ = offset; };
+
+		/// <summary>
+		/// Get current position
+		/// </summary>
+		/// <returns>The byte offset</returns>
+		uint64 tell() const { return pos_; };
+
+		/// <summary>
+		/// Get file size, including buffered writes
+		/// </summary>
+		/// <returns>Size in bytes</returns>
+		uint64 size();
+
+		/// <summary>
+		/// Write buffered data to the file.
+		/// </summary>
+		void flush();
+
+		/// <summary>
+		/// Write buffered data and wait until it is on the storage device.
+		/// </summary>
+		void sync();
+
+		/// <summary>
+		/// Truncate or extend the file, buffered data is written first.
+		/// </summary>
+		/// <param name="size">The new size in bytes.</param>
+		void resize(uint64 size);
+
+	private:
+		// hide public default constructor
+		BinaryFile();
+		BinaryFile(const BinaryFile&);
+		BinaryFile& operator=(const BinaryFile&);
+
+		size_t read_bytes(void *dst, size_t len, size_t elemSize);
+		size_t write_bytes(const void *src, size_t len, size_t elemSize);
+		size_t read_bytes_at(uint64 offset, void *dst, size_t len, size_t elemSize);
+		size_t write_bytes_at(uint64 offset, const void *src, size_t len, size_t elemSize);
+		size_t read_all_bytes(AlignedBuffer &buf, size_t elemSize);
+		// unbuffered positional IO on a descriptor
+		size_t pread_full(int fd, uint64 offset, void *dst, size_t len);
+		void pwrite_full(int fd, uint64 offset, const void *src, size_t len);
+		// positional IO honoring the cache mode
+		size_t read_raw(uint64 offset, void *dst, size_t len);
+		void write_raw(uint64 offset, const void *src, size_t len);
+		// write pending data, all or only whole direct IO blocks
+		void write_buffer(bool all);
+		void drop_cache(uint64 offset, size_t len, bool written);
+		void close_direct();
+		bool need_swap(size_t elemSize) const { return swap_ && elemSize > 1; };
+
+		int			fd_;
+		int			fdDirect_;	// O_DIRECT descriptor in DIRECT mode
+		int			cacheMode_;
+		int			endian_;
+		bool		swap_;		// file endianness differs from machine
+		uint64		pos_;		// current position
+		AlignedBuffer	buf_;
+		AlignedBuffer	bounce_;	// aligned copy of unaligned direct IO
+		uint64		bufOffset_;	// file offset of buf_[0]
+		size_t		rlen_;		// valid bytes read into buf_
+		size_t		wlen_;		// pending bytes to write from buf_
+		uint64		dirtyOffset_;	// range written in STREAMING mode, dropped after writeback
+		size_t		dirtyLen_;
+	};
+
+	/// <summary>
+	/// Untyped core of RecordFile, works on records of a fixed size in bytes.
+	/// </summary>
+	class RecordFileBase
+	{
+	public:
+		/// <summary>
+		/// Number of records, including appended ones not committed yet
+		/// </summary>
+		/// <returns>Number of records</returns>
+		uint64 size() const { return count_ + pending_; };
+
+		/// <summary>
+		/// Number of records guaranteed to survive a crash
+		/// </summary>
+		/// <returns>Number of records</returns>
+		uint64 committed() const { return count_; };
+
+		/// <summary>
+		/// Make appended records durable: write and sync them, then update the count in header.
+		/// </summary>
+		void commit();
+
+	protected:
+		RecordFileBase(const String &path, size_t recordSize, int writable, size_t commitRecords);
+		~RecordFileBase();
+
+		void read_records(uint64 first, size_t count, void *dst);
+		void append_records(const void *src, size_t count);
+
+	private:
+		RecordFileBase(const RecordFileBase&);
+		RecordFileBase& operator=(const RecordFileBase&);
+
+		// create missing file, return mode to open it
+		static std::ios_base::openmode prepare(const String &path, int writable);
+
+		BinaryFile	file_;
+		size_t		recordSize_;
+		bool		writable_;
+		size_t		commitRecords_;
+		uint64		count_;		// committed records
+		uint64		pending_;	// appended records not committed
+	};
+
+	/// <summary>
+	/// Append-only file of fixed-size records of T with O(1) random access.
+	/// A 64 byte header holds magic, version, record size and the committed count. Appends are
+	/// buffered and committed in groups: data is synced before the count is updated, so after a
+	/// crash the file reopens with the last committed count and torn records are dropped.
+	/// T must be a plain struct, records are stored with native layout and byte order.
+	/// <code>
+	/// RecordFile&lt;Tick&gt; ticks("ticks.rec");
+	/// ticks.append(tick);
+	/// Tick last = ticks.get(ticks.size() - 1);
+	/// </code>
+	/// </summary>
+	template<typename T> class RecordFile : public RecordFileBase
+	{
+	public:
+		/// <summary>
+		/// Initializes a new instance of the <see cref="RecordFile"/> class.
+		/// Throws IOException if the file exists with another format or record size.
+		/// </summary>
+		/// <param name="path">The file path, created if writable and not existing.</param>
+		/// <param name="writable">Open for appending(1) or read-only(0).</param>
+		/// <param name="commitRecords">Commit automatically after this many appended records.</param>
+		explicit RecordFile(const String &path, int writable = 1, size_t commitRecords = 4096)
+			: RecordFileBase(path, sizeof(T), writable, commitRecords) {};
+
+		/// <summary>
+		/// Get the i-th record, throws ArgException if out of range.
+		/// </summary>
+		/// <param name="i">The index.</param>
+		/// <returns>The record</returns>
+		T get(uint64 i)
+		{
+			T rec;
+			read_records(i, 1, &rec);
+			return rec;
+		}
+
+		/// <summary>
+		/// Read count consecutive records with one read, throws ArgException if out of range.
+		/// </summary>
+		/// <param name="first">Index of first record.</param>
+		/// <param name="count">Number of records.</param>
+		/// <param name="dst">The destination.</param>
+		void get_range(uint64 first, size_t count, T *dst) { read_records(first, count, dst); };
+
+		/// <summary>
+		/// Append one record.
+		/// </summary>
+		/// <param name="rec">The record.</param>
+		void append(const T &rec) { append_records(&rec, 1); };
+
+		/// <summary>
+		/// Append count records.
+		/// </summary>
+		/// <param name="recs">The records.</param>
+		/// <param name="count">Number of records.</param>
+		void append(const T *recs, size_t count) { append_records(recs, count); };
+	};
+
+	/// <summary>
+	/// Worst case size of lz_compress() output
+	/// </summary>
+	/// <param name="len">The input length.</param>
+	/// <returns>Size in bytes</returns>
+	inline size_t lz_compress_bound(size_t len) { return len + len / 255 + 16; }
+
+	/// <summary>
+	/// Compress a memory block with the built-in LZ codec(LZ4 block format), no dependency needed.
+	/// </summary>
+	/// <param name="src">The input.</param>
+	/// <param name="len">The input length.</param>
+	/// <param name="dst">The output.</param>
+	/// <param name="capacity">Size of output, lz_compress_bound(len) always fits.</param>
+	/// <returns>Compressed size, 0 if it does not fit in capacity</returns>
+	size_t lz_compress(const char *src, size_t len, char *dst, size_t capacity);
+
+	/// <summary>
+	/// Decompress a block produced by lz_compress(), corrupted input is detected.
+	/// </summary>
+	/// <param name="src">The compressed block.</param>
+	/// <param name="len">The compressed length.</param>
+	/// <param name="dst">The output.</param>
+	/// <param name="rawLen">The exact decompressed length.</param>
+	/// <returns>true if succeeded</returns>
+	bool lz_decompress(const char *src, size_t len, char *dst, size_t rawLen);
+
+	/// <summary>
+	/// Writer of block compressed files. Data is cut into fixed size blocks compressed
+	/// independently and in parallel, a trailing block index allows reading any byte range
+	/// by decompressing only the blocks covering it, see BlockFileReader.
+	/// </summary>
+	class BlockFileWriter
+	{
+	public:
+		/// <summary>
+		/// Initializes a new instance of the <see cref="BlockFileWriter"/> class, the file is overwritten.
+		/// </summary>
+		/// <param name="path">The file path.</param>
+		/// <param name="blockSize">Uncompressed size of each block, 64KB to 1MB recommended.</param>
+		/// <param name="threads">Number of compression threads, use all processors if &lt;= 0.</param>
+		BlockFileWriter(const String &path, size_t blockSize = 256 * 1024, int threads = 0);
+		~BlockFileWriter();
+
+		/// <summary>
+		/// Append data.
+		/// </summary>
+		/// <param name="data">The data.</param>
+		/// <param name="len">The length in bytes.</param>
+		void write(const void *data, size_t len);
+
+		/// <summary>
+		/// Compress remaining data and write the block index. Called by destructor.
+		/// </summary>
+		void close();
+
+		uint64 size() const { return rawSize_; };
+		uint64 compressed_size() const { return offset_; };
+
+	private:
+		BlockFileWriter(const BlockFileWriter&);
+		BlockFileWriter& operator=(const BlockFileWriter&);
+
+		// compress buffered blocks in parallel and append them in order
+		void flush_blocks();
+
+		BinaryFile	file_;
+		size_t		blockSize_;
+		int			threads_;
+		std::vector<char>	pending_;	// uncompressed data of up to a few blocks per thread
+		size_t		pendingLen_;
+		std::vector<char>	out_;		// compressed blocks
+		std::vector<uint64>	index_;		// offset, compressed size, raw size, codec of each block
+		uint64		rawSize_;
+		uint64		offset_;	// end of compressed data
+		bool		closed_;
+	};
+
+	/// <summary>
+	/// Random access reader of files written by BlockFileWriter.
+	/// <code>
+	/// BlockFileReader reader("events.blk");
+	/// std::vector&lt;char&gt; buf(1000);
+	/// reader.read(123456789, &amp;buf.front(), buf.size());
+	/// </code>
+	/// </summary>
+	class BlockFileReader
+	{
+	public:
+		/// <summary>
+		/// Initializes a new instance of the <see cref="BlockFileReader"/> class.
+		/// Throws IOException if the file is not a valid block file.
+		/// </summary>
+		/// <param name="path">The file path.</param>
+		/// <param name="threads">Number of decompression threads, use all processors if &lt;= 0.</param>
+		BlockFileReader(const String &path, int threads = 0);
+
+		/// <summary>
+		/// Read uncompressed bytes, blocks covering the range are read with one IO and
+		/// decompressed in parallel.
+		/// </summary>
+		/// <param name="offset">The uncompressed offset.</param>
+		/// <param name="dst">The destination.</param>
+		/// <param name="len">Number of bytes.</param>
+		/// <returns>Number of bytes read, less than len only at end of data</returns>
+		size_t read(uint64 offset, void *dst, size_t len);
+
+		uint64 size() const { return rawSize_; };
+		size_t block_size() const { return blockSize_; };
+		size_t num_blocks() const { return index_.size() / 4; };
+
+	private:
+		BlockFileReader(const BlockFileReader&);
+		BlockFileReader& operator=(const BlockFileReader&);
+
+		BinaryFile	file_;
+		size_t		blockSize_;
+		int			threads_;
+		uint64		rawSize_;
+		std::vector<uint64>	index_;		// offset, compressed size, raw size, codec of each block
+		std::vector<char>	comp_;		// compressed blocks of current read
+		std::vector<char>	cache_;		// last partially read block
+		size_t		cachedBlock_;
+	};
+
+	/// <summary>
+	/// Appends durable records from many threads, a single flusher thread writes each group
+	/// of records with one write and one fdatasync. Every append returns a ticket, wait()
+	/// returns once that record is on the storage device. A group is written when it reaches
+	/// maxBatch bytes, its oldest record has waited maxLatencyMs, or a caller waits on one
+	/// of its records. Records appended while a group is being synced form the next group.
+	/// <code>
+	/// GroupCommitWriter log("events.log");
+	/// uint64 ticket = log.append(rec, len);
+	/// log.wait(ticket);
+	/// </code>
+	/// </summary>
+	class GroupCommitWriter
+	{
+	public:
+		/// <summary>
+		/// Initializes a new instance of the <see cref="GroupCommitWriter"/> class.
+		/// Records are appended to the file, which is created if missing.
+		/// </summary>
+		/// <param name="path">The file path.</param>
+		/// <param name="maxLatencyMs">Longest time a record waits before its group is written.</param>
+		/// <param name="maxBatch">Largest group in bytes, appends block while the group is full.</param>
+		GroupCommitWriter(const String &path, int maxLatencyMs = 2, size_t maxBatch = 1024 * 1024);
+		~GroupCommitWriter();
+
+		/// <summary>
+		/// Append a record, thread safe. Returns before the record is durable.
+		/// </summary>
+		/// <param name="data">The record.</param>
+		/// <param name="len">The length in bytes.</param>
+		/// <returns>Durability ticket of the record</returns>
+		uint64 append(const void *data, size_t len);
+
+		/// <summary>
+		/// Wait until the record of ticket is durable, throws IOException if writing failed.
+		/// </summary>
+		/// <param name="ticket">The ticket returned by append().</param>
+		void wait(uint64 ticket);
+
+		/// <summary>
+		/// Append a record and wait until it is durable.
+		/// </summary>
+		/// <param name="data">The record.</param>
+		/// <param name="len">The length in bytes.</param>
+		/// <returns>Durability ticket of the record</returns>
+		uint64 commit(const void *data, size_t len);
+
+		/// <summary>
+		/// Wait until all records appended so far are durable.
+		/// </summary>
+		void flush();
+
+		/// <summary>
+		/// Check if the record of ticket is durable.
+		/// </summary>
+		/// <param name="ticket">The ticket returned by append().</param>
+		/// <returns>true if durable</returns>
+		bool is_durable(uint64 ticket);
+
+		/// <summary>
+		/// Write remaining records and stop the flusher thread. Called by destructor.
+		/// </summary>
+		void close();
+
+	private:
+		GroupCommitWriter(const GroupCommitWriter&);
+		GroupCommitWriter& operator=(const GroupCommitWriter&);
+
+		static void flusher(void *self);
+
+		String		path_;
+		BinaryFile	file_;		// only used by the flusher thread
+		int			maxLatencyMs_;
+		size_t		maxBatch_;
+		std::vector<char>	active_;	// group being appended to
+		std::vector<char>	writing_;	// group being written
+		double		oldest_;	// time of first record in active_
+		uint64		appended_;	// last ticket issued
+		uint64		durable_;	// last ticket on storage device
+		bool		full_;		// an append waits for room in active_
+		bool		forced_;	// a caller waits, write now
+		bool		failed_;
+		bool		stop_;
+		Mutex		mutex_;
+		CondVar		wake_;		// wakes the flusher
+		CondVar		written_;	// a group was taken or made durable
+		Thread		thread_;
+	};
+
+	// ------------------------------- OS DIRECTORY -----------------------------//
+
+	/// <summary>
+	/// Basic file or directory path container
+	/// </summary>
+	class Path
+	{
+	public:
+		/// <summary>
+		/// Initializes a new instance of the <see cref="Path"/> class.
+		/// </summary>
+		/// <param name="path">The path.</param>
+		Path(String path) { this->path_ = reform(path); };
+
+		/// <summary>
+		/// Return absolute path of the specified reletive path.
+		/// </summary>
+		/// <param name="reletivePath">The reletive path.</param>
+		/// <returns>The absolute path.</returns>
+		static String get_real_path(String reletivePath);
+
+		/// <summary>
+		/// Get current working directory.
+		/// </summary>
+		/// <returns>Current working directory.</returns>
+		static String get_cwd();
+
+		/// <summary>
+		/// Remove substrings from the specified string.
+		/// </summary>
+		/// <param name="substring">The substring.</param>
+		/// <param name="toTrim">To string to trim from.</param>
+		inline static void remove_substring(const String & substring, String &toTrim)
+		{
+			String::size_type i = toTrim.find(substring);
+			if (i != String::npos)
+			{
+				toTrim.erase(i, substring.length());
+			}
+		}
+
+		/// <summary>
+		/// Check if the specified path is a valid directory.
+		/// </summary>
+		/// <param name="path">The path.</param>
+		/// <returns>1 if directory, 0 if file, -1 otherwise</returns>
+		static int is_directory(String path);
+
+		/// <summary>
+		/// Check if the specified path exists.
+		/// </summary>
+		/// <param name="path">The path.</param>
+		/// <returns>1 if exist, 0 if not exist, -1 for other possible situations</returns>
+		static int is_exist(String path);
+
+		/// <summary>
+		/// Convert backslashes to trailing slashes if any and remove duplicate slashes
+		/// </summary>
+		/// <param name="orig">The original path.</param>
+		/// <returns>Reformed path.</returns>
+		static String reform(String orig);
+
+		/// <summary>
+		/// Check if is directory, member function
+		/// </summary>
+		/// <returns>1 if directory, 0 if file, -1 otherwise</returns>
+		int dir() { return is_directory(this->path_); };
+
+		/// <summary>
+		/// Check if path exists.
+		/// </summary>
+		/// <returns>1 if exist, 0 if not exist, -1 for other possible situations</returns>
+		int exist() { return is_exist(this->path_); };
+
+		/// <summary>
+		/// Prune directory of full path
+		/// </summary>
+		/// <returns>Directory</returns>
+		String get_dir();
+
+		/// <summary>
+		/// Prune pure filename without extension
+		/// </summary>
+		/// <returns>Pure filename</returns>
+		String get_basename();
+
+		/// <summary>
+		/// Get extension
+		/// </summary>
+		/// <returns>Extension or empty string(if no extension)</returns>
+		String get_extension();
+
+		/// <summary>
+		/// Get full path
+		/// </summary>
+		/// <returns>Full path</returns>
+		String str() { return this->path_; };
+
+		/// <summary>
+		/// Set path.
+		/// </summary>
+		/// <param name="path">The new path.</param>
+		void set_path(String path) { path_ = reform(path); };
+
+		/// <summary>
+		/// Match wildcards, use WildcardPattern to match one pattern many times.
+		/// </summary>
+		/// <param name="first">The wildcard char string.</param>
+		/// <param name="second">The string to match.</param>
+		/// <returns>True if matches, false otherwise.</returns>
+		static bool wildcard_match(const char *first, const char *second);
+
+	private:
+
+		String path_;
+	};
+
+	/// <summary>
+	/// Wildcard pattern compiled once and matched many times. '*' matches any sequence,
+	/// including '/', and '?' matches any single char. The literal head and tail are checked
+	/// first, the parts between '*' are then found leftmost-first without backtracking,
+	/// so matching never takes exponential time. Case-insensitive matching folds ASCII
+	/// letters on the fly, nothing is copied.
+	/// </summary>
+	class WildcardPattern
+	{
+	public:
+		/// <summary>
+		/// Compile the pattern.
+		/// </summary>
+		/// <param name="pattern">The wildcard pattern.</param>
+		/// <param name="caseSensitive">Is case sensitive?</param>
+		explicit WildcardPattern(const String &pattern, int caseSensitive = 1);
+
+		/// <summary>
+		/// Match the whole string against the pattern.
+		/// </summary>
+		/// <param name="str">The string to match.</param>
+		/// <param name="len">Length of str.</param>
+		/// <returns>True if matches, false otherwise.</returns>
+		bool match(const char *str, size_t len) const;
+		bool match(const char *str) const;
+		bool match(const String &str) const { return match(str.c_str(), str.size()); };
+
+		/// <summary>
+		/// The pattern as given.
+		/// </summary>
+		/// <returns>Pattern</returns>
+		const String& str() const { return pattern_; };
+
+	private:
+		bool equal_at(const String &part, const char *text) const;
+
+		String	pattern_;
+		int		caseSensitive_;
+		bool	hasStar_;
+		String	prefix_;	// before the first '*', or the whole pattern without '*'
+		String	suffix_;	// after the last '*'
+		std::vector<String>	middle_;	// parts between stars
+		size_t	minLength_;	// chars a matching string needs at least
+	};
+
+	/// <summary>
+	/// OS directory list handler class
+	/// </summary>
+	class Dir
+	{
+	public:
+		/// <summary>
+		/// Initializes a new instance of the <see cref="Dir"/> class.
+		/// </summary>
+		/// <param name="path">The path.</param>
+		/// <param name="recurse">Recursive?</param>
+		/// <param name="showHidden">Show hidden files/directories?</param>
+		Dir(String path, int recurse = 0, int showHidden = 0) { search(path, recurse, showHidden); };
+
+		/// <summary>
+		/// Create the specified directory.
+		/// Will automatically create intermediate directories if necessary.
+		/// </summary>
+		/// <param name="dir">The dir.</param>
+		/// <returns></returns>
+		static int mk_dir(String dir);
+
+		/// <summary>
+		/// Search recursively?
+		/// </summary>
+		/// <returns>1 if true, 0 otherwise</returns>
+		int is_recursive() { return recursive_; };
+
+		/// <summary>
+		/// Is hidden file/directory shown?
+		/// </summary>
+		/// <returns>1 if true, 0 otherwise</returns>
+		int is_show_hidden() { return showHidden_; };
+
+		/// <summary>
+		/// Set recursion mode
+		/// </summary>
+		/// <param name="r">Use recursion(1) or not(0).</param>
+		void set_recursive(int recursive) { recursive_ = recursive; };
+
+		/// <summary>
+		/// Set whether to show hidden files/directories.
+		/// </summary>
+		/// <param name="s">Show hidden(1) or not(0).</param>
+		void set_show_hidden(int showHidden) { showHidden_ = showHidden; };
+
+		/// <summary>
+		/// Return root path of this directory
+		/// </summary>
+		/// <returns>Root path</returns>
+		String str() const { return root_; };
+
+		/// <summary>
+		/// List files
+		/// </summary>
+		/// <param name="abosolute">Use absolute path or not.</param>
+		/// <returns>Vector of filenames in String.</returns>
+		Vecstr list_files(int absolutePath = 0);
+
+		/// <summary>
+		/// List files given the specified wildcards to match.
 		/// </summary>
 		/// <param name="wildcards">The wildcards.</param>
 		/// <param name="caseSensitive">Is case sensitive?.</param>
@@ -933,20 +2660,57 @@ namespace zz
 		/// Get files in this directory
 		/// </summary>
 		/// <returns>files</returns>
-		const std::vector<String>& get_files() { return files_; };
+		const std::vector<String>& get_files() const { return files_; };
 
 		/// <summary>
 		/// Get sub-folders in this directory
 		/// </summary>
 		/// <returns>sub-folders</returns>
-		const std::vector<Dir>& get_subfolders() { return childs_; };
+		const std::vector<Dir>& get_subfolders() const { return childs_; };
+
+		/// <summary>
+		/// Callback receiving a batch of full file paths from walk_parallel.
+		/// Calls are serialized, the callback needs no locking of its own.
+		/// </summary>
+		typedef void(*WalkCallback)(const Vecstr &files, void *context);
+
+		/// <summary>
+		/// Walk a directory tree recursively with several threads. Each thread keeps its
+		/// pending folders in its own deque, idle threads steal folders from the others.
+		/// Hidden and '~' backup files are filtered the same way as searching a Dir.
+		/// Throws IOException after the walk if any folder failed to read.
+		/// </summary>
+		/// <param name="root">The root directory.</param>
+		/// <param name="threads">Number of threads, 0 for one per processor.</param>
+		/// <param name="callback">Called with the files of each folder, or once with all files if sorted.</param>
+		/// <param name="context">Passed to callback unchanged.</param>
+		/// <param name="showHidden">Show hidden files/directories?</param>
+		/// <param name="sorted">Deliver all files sorted in a single batch after the walk?</param>
+		/// <returns>Number of files found</returns>
+		static size_t walk_parallel(String root, int threads, WalkCallback callback, void *context = NULL, int showHidden = 0, int sorted = 0);
+
+		/// <summary>
+		/// Set the buffer size used to read directory entries with getdents64 on Linux,
+		/// shared by all Dir searches and walks. Larger buffers need fewer system calls
+		/// on huge folders. Default 256KB, at least 4KB.
+		/// </summary>
+		/// <param name="bytes">The buffer size in bytes.</param>
+		static void set_read_buffer_size(size_t bytes);
+
+		/// <summary>
+		/// Buffer size used to read directory entries.
+		/// </summary>
+		/// <returns>Size in bytes</returns>
+		static size_t read_buffer_size();
 
-		
 	private:
 		// hide default constructor
 		Dir() { recursive_ = 0; showHidden_ = 0; };
 
+		// walk the tree with an explicit stack, children are filled in place
 		void search();
+		// read entries of root_ only, subfolders are added with root_ set but not searched
+		void scan(std::vector<char> &buffer);
 		void search(String path, int recurse = 0, int showHidden = 0)
 		{
 			set_root(path);
@@ -961,6 +2725,126 @@ namespace zz
 		std::vector<String>		files_;
 		std::vector<Dir>		childs_;
 	};
+
+	/// <summary>
+	/// Lazy directory walk yielding files and folders one at a time in directory order,
+	/// filtered the same way as Dir. Only the open directory handles of the current
+	/// path are kept, so memory is bounded by the depth of the tree, not its size.
+	/// A folder is returned before its content.
+	/// Usage: for (DirIterator it(path); !it.end(); it.next()) { use it.path() }
+	/// </summary>
+	class DirIterator
+	{
+	public:
+		/// <summary>
+		/// Open the root directory and move to the first entry. Throws IOException if it is not a directory.
+		/// </summary>
+		/// <param name="path">The root path.</param>
+		/// <param name="recurse">Walk into subfolders?</param>
+		/// <param name="showHidden">Show hidden files/directories?</param>
+		DirIterator(String path, int recurse = 1, int showHidden = 0);
+		~DirIterator();
+
+		/// <summary>
+		/// Move to the next entry. Throws IOException if a subfolder cannot be opened,
+		/// the subfolder is skipped and the walk can go on with next().
+		/// </summary>
+		/// <returns>false when the walk is finished</returns>
+		bool next();
+
+		/// <summary>
+		/// Check if the walk is finished.
+		/// </summary>
+		/// <returns>true if no entry left</returns>
+		bool end() const { return stack_.empty(); };
+
+		/// <summary>
+		/// Do not walk into the current folder, no effect on files.
+		/// </summary>
+		void skip_subtree() { descend_ = false; };
+
+		/// <summary>
+		/// Full path of the current entry.
+		/// </summary>
+		/// <returns>Path</returns>
+		const String& path() const { return path_; };
+
+		/// <summary>
+		/// Name of the current entry without folder.
+		/// </summary>
+		/// <returns>Name</returns>
+		const String& name() const { return name_; };
+
+		/// <summary>
+		/// Is the current entry a folder?
+		/// </summary>
+		/// <returns>true if folder</returns>
+		bool is_directory() const { return isDir_; };
+
+		/// <summary>
+		/// Depth of the current entry, 0 for entries directly in root.
+		/// </summary>
+		/// <returns>Depth</returns>
+		int depth() const { return static_cast<int>(stack_.size()) - 1; };
+
+		DirIterator& operator++() { next(); return *this; };
+		const String& operator*() const { return path_; };
+
+	private:
+		DirIterator(const DirIterator&);
+		DirIterator& operator=(const DirIterator&);
+
+		void push(const String &folder);
+		void pop();
+
+		struct Level
+		{
+			void*	handle;		// OS specific directory handle
+			String	path;
+		};
+
+		int		recursive_;
+		int		showHidden_;
+		std::vector<Level>	stack_;
+		String	name_;
+		String	path_;
+		bool	isDir_;
+		bool	descend_;	// walk into the current folder on next()
+	};
+
+	/// <summary>
+	/// Copy a regular file without passing data through user space where the OS allows:
+	/// copy_file_range on Linux, falling back to sendfile and then to a buffered copy.
+	/// Holes of sparse files are preserved, permissions and modification time are kept.
+	/// Throws IOException on failure.
+	/// </summary>
+	/// <param name="src">The source file.</param>
+	/// <param name="dst">The destination file, overwritten if exists.</param>
+	/// <param name="reflink">Try a copy-on-write clone first(1), which shares data blocks on btrfs, xfs and similar.</param>
+	/// <returns>Size of the file in bytes</returns>
+	uint64 copy_file(const String &src, const String &dst, int reflink = 0);
+
+	/// <summary>
+	/// Move a file or directory by renaming it, files on another file system are copied
+	/// with copy_file and then removed. Throws IOException on failure.
+	/// </summary>
+	/// <param name="src">The source path.</param>
+	/// <param name="dst">The destination path, an existing file is replaced.</param>
+	void move_file(const String &src, const String &dst);
+
+	/// <summary>
+	/// Copy a directory tree, every entry included: hidden and '~' backup files are not
+	/// filtered as Dir does. Directories are created first, then files are copied with
+	/// copy_file by a bounded number of threads. Symbolic links are recreated as links on
+	/// POSIX systems, never followed. Pipes, sockets and devices are skipped.
+	/// Throws IOException if any file fails after all others are done.
+	/// </summary>
+	/// <param name="src">The source directory.</param>
+	/// <param name="dst">The destination directory, created if missing.</param>
+	/// <param name="threads">Maximum number of files copied at the same time.</param>
+	/// <param name="reflink">Try copy-on-write clones first(1).</param>
+	/// <returns>Number of files and links copied</returns>
+	size_t copy_tree(const String &src, const String &dst, int threads = 4, int reflink = 0);
 }
 
 